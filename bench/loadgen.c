@@ -0,0 +1,214 @@
+// Load generator for `calc -s`. Every client thread keeps up to a pipeline
+// depth of requests in flight on its own connection, and the latency of each
+// request is measured from sending it to reading its response.
+//
+// loadgen <socket> [-c clients] [-n requests per client] [-p pipeline depth]
+//                  [-e expression] [-v variable count]
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../source/server.h"
+
+#define RECEIVE_SIZE 65536
+
+typedef struct {
+    const char* socket_path;
+    const char* expression;
+    uint32_t variable_count;
+    uint32_t requests;
+    uint32_t depth;
+} Settings;
+
+typedef struct {
+    const Settings* settings;
+    pthread_t thread;
+    uint64_t* latencies; // nanoseconds, one per request
+    uint32_t errors;
+    bool failed;
+} Client;
+
+static uint64_t now_ns() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+static bool write_all(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t amount = write(fd, data, size);
+        if (amount <= 0) return false;
+        data += amount;
+        size -= amount;
+    }
+    return true;
+}
+
+static int connect_to(const char* socket_path) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void* client_main(void* argument) {
+    Client* client = argument;
+    const Settings* settings = client->settings;
+
+    int fd = connect_to(settings->socket_path);
+    if (fd < 0) {
+        client->failed = true;
+        return NULL;
+    }
+
+    uint16_t source_length = strlen(settings->expression);
+    uint16_t variable_count = settings->variable_count;
+    size_t frame_size = SERVER_REQUEST_HEADER_SIZE + source_length + sizeof(float) * variable_count;
+    uint8_t* frame = malloc(frame_size);
+    memcpy(frame + 4, &source_length, sizeof(source_length));
+    memcpy(frame + 6, &variable_count, sizeof(variable_count));
+    memcpy(frame + SERVER_REQUEST_HEADER_SIZE, settings->expression, source_length);
+
+    uint64_t* sent_at = malloc(sizeof(uint64_t) * settings->requests);
+    uint8_t* received = malloc(RECEIVE_SIZE);
+    size_t received_length = 0;
+    unsigned int seed = (unsigned int)(uintptr_t)client;
+
+    uint32_t sent = 0;
+    uint32_t answered = 0;
+    while (answered < settings->requests) {
+        while (sent < settings->requests && sent - answered < settings->depth) {
+            uint32_t id = sent;
+            memcpy(frame, &id, sizeof(id));
+            for (uint32_t i = 0; i < variable_count; ++i) {
+                float value = (float)rand_r(&seed) / RAND_MAX * 10.0f;
+                memcpy(frame + SERVER_REQUEST_HEADER_SIZE + source_length + sizeof(float) * i, &value, sizeof(value));
+            }
+            sent_at[id] = now_ns();
+            if (!write_all(fd, frame, frame_size)) {
+                client->failed = true;
+                goto done;
+            }
+            ++sent;
+        }
+
+        ssize_t amount = read(fd, received + received_length, RECEIVE_SIZE - received_length);
+        if (amount <= 0) {
+            client->failed = true;
+            goto done;
+        }
+        received_length += amount;
+
+        uint64_t arrived = now_ns();
+        size_t offset = 0;
+        for (; received_length - offset >= SERVER_RESPONSE_SIZE; offset += SERVER_RESPONSE_SIZE) {
+            uint32_t id;
+            memcpy(&id, received + offset, sizeof(id));
+            if (received[offset + 4] != SERVER_STATUS_OK) ++client->errors;
+            if (id < settings->requests) client->latencies[answered++] = arrived - sent_at[id];
+        }
+        memmove(received, received + offset, received_length - offset);
+        received_length -= offset;
+    }
+
+done:
+    free(frame);
+    free(sent_at);
+    free(received);
+    close(fd);
+    return NULL;
+}
+
+static int compare_latencies(const void* a, const void* b) {
+    uint64_t latency_a = *(const uint64_t*)a;
+    uint64_t latency_b = *(const uint64_t*)b;
+    return latency_a < latency_b ? -1 : latency_a > latency_b;
+}
+
+static double percentile_us(uint64_t* sorted, size_t count, double percentile) {
+    size_t index = (size_t)(percentile / 100.0 * (count - 1));
+    return sorted[index] / 1000.0;
+}
+
+int main(int argc, char** argv) {
+    --argc; ++argv; // consume program name
+    if (argc < 1) {
+        fprintf(stderr, "usage: loadgen <socket> [-c clients] [-n requests] [-p depth] [-e expression] [-v variables]\n");
+        return 1;
+    }
+
+    Settings settings = {
+        .socket_path = argv[0],
+        .expression = "x * y + 2 ^ x",
+        .variable_count = 2,
+        .requests = 100000,
+        .depth = 16};
+    uint32_t client_count = 8;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-c") == 0) client_count = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-n") == 0) settings.requests = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-p") == 0) settings.depth = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-e") == 0) settings.expression = argv[i + 1];
+        else if (strcmp(argv[i], "-v") == 0) settings.variable_count = atoi(argv[i + 1]);
+    }
+    if (client_count == 0 || settings.requests == 0 || settings.depth == 0) {
+        fprintf(stderr, "clients, requests and depth must be positive\n");
+        return 1;
+    }
+
+    Client* clients = calloc(client_count, sizeof(Client));
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < client_count; ++i) {
+        clients[i].settings = &settings;
+        clients[i].latencies = malloc(sizeof(uint64_t) * settings.requests);
+        pthread_create(&clients[i].thread, NULL, client_main, &clients[i]);
+    }
+
+    size_t total = (size_t)client_count * settings.requests;
+    uint64_t* latencies = malloc(sizeof(uint64_t) * total);
+    uint32_t errors = 0;
+    bool failed = false;
+    for (uint32_t i = 0; i < client_count; ++i) {
+        pthread_join(clients[i].thread, NULL);
+        memcpy(&latencies[(size_t)i * settings.requests], clients[i].latencies, sizeof(uint64_t) * settings.requests);
+        errors += clients[i].errors;
+        failed = failed || clients[i].failed;
+        free(clients[i].latencies);
+    }
+    double seconds = (now_ns() - start) / 1e9;
+    free(clients);
+
+    if (failed) {
+        fprintf(stderr, "Connection to %s failed\n", settings.socket_path);
+        free(latencies);
+        return 1;
+    }
+
+    qsort(latencies, total, sizeof(uint64_t), compare_latencies);
+    printf("requests:   %zu in %.3f s, %u errors\n", total, seconds, errors);
+    printf("throughput: %.0f requests/s\n", total / seconds);
+    printf("latency:    p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+           percentile_us(latencies, total, 50.0), percentile_us(latencies, total, 90.0),
+           percentile_us(latencies, total, 99.0), percentile_us(latencies, total, 99.9),
+           latencies[total - 1] / 1000.0);
+
+    free(latencies);
+    return 0;
+}
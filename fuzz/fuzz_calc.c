@@ -0,0 +1,573 @@
+// Fuzzing and differential-testing harness for the tokenizer, parser and all
+// evaluation backends.
+//
+// With libFuzzer (clang, see `make fuzz_calc`) LLVMFuzzerTestOneInput() is the
+// entry point. Without it, a main() is compiled that runs every file given on
+// the command line, or stdin when there are none, which is what AFL expects.
+//
+// Every input that tokenizes and parses is evaluated by interpret(),
+// run_program(), run_program_batch(), evaluate_forward() and
+// evaluate_reverse(). The values must agree, and both differentiation modes
+// must produce the same gradient wherever it is finite. On startup both modes
+// are also checked against hand-derived gradients, which catches derivative
+// formulas they share. The input is also compiled through expreval_compile()
+// with an allocator that fails after every possible amount of allocations,
+// which must report EXPREVAL_OUT_OF_MEMORY without leaking, and through
+// expreval_compile_limited() with tight limits, which must either agree with
+// the unlimited expression or report EXPREVAL_LIMIT_EXCEEDED. On startup chains
+// far longer than any limit are compiled with and without limits, and deep
+// nesting must stop at the built-in cap.
+//
+// With --scaling (or CALC_FUZZ_SCALING=1 under libFuzzer) each accepted input is
+// also repeated into ever longer expressions. The harness aborts when the time
+// needed to tokenize, parse, compile or evaluate with any backend grows faster
+// than length^SCALING_LIMIT.
+//
+// --random <count> [seed] runs generated well-formed expressions instead of
+// files, which reach far more operator combinations than the corpus.
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../source/compiler.h"
+#include "../source/differentiate.h"
+#include "../source/expreval.h"
+#include "../source/interpreter.h"
+#include "../source/parser.h"
+#include "../source/tokenizer.h"
+
+#define MAX_INPUT_SIZE 4096
+#define TOLERANCE 1e-3
+#define BATCH_ROWS 67 // more than one block of run_program_batch()
+
+#define SCALING_START 32     // copies of the input in the smallest expression
+#define SCALING_STEPS 4      // how many times the copies are doubled
+#define SCALING_LIMIT 1.5    // growth exponent, linear would be 1.0
+#define SCALING_NOISE 200000 // nanoseconds, faster phases are not judged
+#define SCALING_RUNS 5       // best of this many runs is used
+
+#define RANDOM_DEPTH 6 // nesting of generated expressions
+
+#define CHAIN_LENGTH 200000 // operators in the long chains checked on startup
+
+typedef enum {
+    PHASE_TOKENIZE,
+    PHASE_PARSE,
+    PHASE_COMPILE,
+    PHASE_INTERPRET,
+    PHASE_RUN_PROGRAM,
+    PHASE_RUN_PROGRAM_BATCH,
+    PHASE_FORWARD,
+    PHASE_REVERSE,
+    PHASE_COUNT,
+} Phase;
+
+static const char* phase_names[PHASE_COUNT] = {
+    "tokenize", "parse", "compile", "interpret", "run_program", "run_program_batch",
+    "evaluate_forward", "evaluate_reverse"};
+
+static bool check_scaling = false;
+
+static uint64_t now_ns() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+// Non-finite results are only checked for being non-finite, the backends
+// are allowed to disagree between inf and nan.
+static bool values_match(float a, float b) {
+    if (!isfinite(a) || !isfinite(b)) return isfinite(a) == isfinite(b);
+    return fabs(a - b) <= TOLERANCE * fmax(1.0, fmax(fabs(a), fabs(b)));
+}
+
+static void report(char* input, char* what, float expected, float actual) {
+    fprintf(stderr, "Mismatch in %s for input \"%s\": expected %f, got %f\n", what, input, expected, actual);
+    abort();
+}
+
+// Returns false when the input is rejected by the tokenizer or parser. Timings
+// of every phase are written to times when it isn't NULL.
+static bool check_input(char* input, uint64_t* times) {
+    uint64_t start = now_ns();
+    Tokenizer* tokenizer = create_tokenizer(NULL);
+    if (!tokenize_str(tokenizer, input)) {
+        free_tokenizer(tokenizer);
+        return false;
+    }
+    uint64_t tokenized = now_ns();
+
+    Parser* parser = create_parser(tokenizer);
+    if (!parse(parser)) {
+        free_parser(parser);
+        return false;
+    }
+    uint64_t parsed = now_ns();
+
+    Program* program = compile(parser->root, NULL);
+    uint64_t compiled = now_ns();
+    Interpreter* interpreter = create_interpreter(parser);
+
+    float* variables = malloc(sizeof(float) * (program->variable_count + 1));
+    for (uint32_t i = 0; i < program->variable_count; ++i) {
+        variables[i] = 0.5 + 0.75 * i;
+        interpreter_set_variable(interpreter, program->variables[i], variables[i]);
+    }
+
+    uint64_t interpret_start = now_ns();
+    float expected = interpret(interpreter);
+    uint64_t interpreted = now_ns();
+
+    float* forward_gradient = malloc(sizeof(float) * (program->variable_count + 1));
+    float* reverse_gradient = malloc(sizeof(float) * (program->variable_count + 1));
+
+    uint64_t run_start = now_ns();
+    float actual = run_program(program, variables);
+    uint64_t run = now_ns();
+    if (!values_match(expected, actual)) report(input, "run_program()", expected, actual);
+
+    uint64_t forward_start = now_ns();
+    actual = evaluate_forward(program, variables, forward_gradient);
+    uint64_t forward = now_ns();
+    if (!values_match(expected, actual)) report(input, "evaluate_forward()", expected, actual);
+
+    uint64_t reverse_start = now_ns();
+    actual = evaluate_reverse(program, variables, reverse_gradient);
+    uint64_t reverse = now_ns();
+    if (!values_match(expected, actual)) report(input, "evaluate_reverse()", expected, actual);
+
+    // The two modes multiply the same partials in a different order, so once
+    // an intermediate product overflows one can end up inf*0 = NaN where the
+    // other multiplied by 0 first. Gradients are only compared when finite.
+    bool finite = isfinite(expected);
+    for (uint32_t i = 0; i < program->variable_count; ++i) {
+        finite = finite && isfinite(forward_gradient[i]) && isfinite(reverse_gradient[i]);
+    }
+    for (uint32_t i = 0; finite && i < program->variable_count; ++i) {
+        if (!values_match(forward_gradient[i], reverse_gradient[i])) {
+            report(input, program->variables[i], forward_gradient[i], reverse_gradient[i]);
+        }
+    }
+
+    // every row gets its own variables and must match run_program() on that row
+    uint32_t count = program->variable_count;
+    float* rows = malloc(sizeof(float) * BATCH_ROWS * (count + 1));
+    float* results = malloc(sizeof(float) * BATCH_ROWS);
+    for (uint32_t row = 0; row < BATCH_ROWS; ++row) {
+        for (uint32_t i = 0; i < count; ++i) {
+            rows[row * count + i] = variables[i] + 0.25 * row - 0.125 * i * row;
+        }
+    }
+    uint64_t batch_start = now_ns();
+    if (!run_program_batch(program, rows, BATCH_ROWS, results)) {
+        fprintf(stderr, "run_program_batch() failed for input \"%s\"\n", input);
+        abort();
+    }
+    uint64_t batch = now_ns();
+    for (uint32_t row = 0; row < BATCH_ROWS; ++row) {
+        float row_expected = run_program(program, &rows[row * count]);
+        if (!values_match(row_expected, results[row])) report(input, "run_program_batch()", row_expected, results[row]);
+    }
+    free(rows);
+    free(results);
+
+    if (times != NULL) {
+        times[PHASE_TOKENIZE] = tokenized - start;
+        times[PHASE_PARSE] = parsed - tokenized;
+        times[PHASE_COMPILE] = compiled - parsed;
+        times[PHASE_INTERPRET] = interpreted - interpret_start;
+        times[PHASE_RUN_PROGRAM] = run - run_start;
+        times[PHASE_RUN_PROGRAM_BATCH] = batch - batch_start;
+        times[PHASE_FORWARD] = forward - forward_start;
+        times[PHASE_REVERSE] = reverse - reverse_start;
+    }
+
+    free(forward_gradient);
+    free(reverse_gradient);
+    free(variables);
+    free_program(program);
+    free_interpreter(interpreter);
+    return true;
+}
+
+typedef struct {
+    char* source;
+    float variables[2]; // x, y
+    float value;
+    float gradient[2];
+} KnownGradient;
+
+static const KnownGradient known_gradients[] = {
+    {"x*y", {3, 5}, 15, {5, 3}},
+    {"x/y", {3, 5}, 0.6, {0.2, -0.12}},
+    {"x^y", {2, 3}, 8, {12, 5.5451774}}, // y * x^(y-1), x^y * ln(x)
+    {"x^3 + y^-2", {2, 0.5}, 12, {12, -16}},
+    {"x^0.5 * y", {4, 3}, 6, {0.75, 2}},
+    {"x > y ? x*y : -y", {2, 1}, 2, {1, 2}},
+    {"clamp(x, 0, 1) + min(x, y)", {0.5, 2}, 1, {2, 0}},
+};
+
+static void check_known_gradients() {
+    for (size_t i = 0; i < sizeof(known_gradients) / sizeof(known_gradients[0]); ++i) {
+        const KnownGradient* known = &known_gradients[i];
+        Tokenizer* tokenizer = create_tokenizer(NULL);
+        tokenize_str(tokenizer, known->source);
+        Parser* parser = create_parser(tokenizer);
+        parse(parser);
+        Program* program = compile(parser->root, NULL);
+        free_parser(parser);
+
+        float gradient[2];
+        float value = evaluate_forward(program, known->variables, gradient);
+        for (int mode = 0; mode < 2; ++mode) {
+            char* what = mode == 0 ? "evaluate_forward()" : "evaluate_reverse()";
+            if (mode == 1) value = evaluate_reverse(program, known->variables, gradient);
+            if (!values_match(known->value, value)) report(known->source, what, known->value, value);
+            for (uint32_t k = 0; k < 2; ++k) {
+                if (!values_match(known->gradient[k], gradient[k])) {
+                    report(known->source, what, known->gradient[k], gradient[k]);
+                }
+            }
+        }
+        free_program(program);
+    }
+}
+
+typedef struct {
+    uint32_t remaining; // allocations that still succeed
+} FailingAllocator;
+
+static void* failing_allocate(void* context, size_t size) {
+    FailingAllocator* allocator = context;
+    if (allocator->remaining == 0) return NULL;
+    --allocator->remaining;
+    return malloc(size);
+}
+
+static void failing_release(void* context, void* pointer) {
+    (void)context;
+    free(pointer);
+}
+
+static void check_out_of_memory(char* input) {
+    for (uint32_t budget = 0;; ++budget) {
+        FailingAllocator state = {.remaining = budget};
+        ExprevalAllocator allocator = {
+            .allocate = failing_allocate,
+            .release = failing_release,
+            .context = &state};
+
+        ExprevalExpression* expression;
+        ExprevalStatus status = expreval_compile(input, &allocator, &expression, NULL, 0);
+        if (status == EXPREVAL_OK) {
+            expreval_free(expression);
+            return;
+        }
+        if (status != EXPREVAL_OUT_OF_MEMORY || expression != NULL) {
+            fprintf(stderr, "expreval_compile() returned %d with %u allocations for input \"%s\"\n", status, budget, input);
+            abort();
+        }
+    }
+}
+
+static const ExprevalLimits tight_limits[] = {
+    {.max_tokens = 16},
+    {.max_nodes = 8},
+    {.max_depth = 2},
+    {.max_memory = 512},
+    {.max_steps = 8},
+    {.max_tokens = 64, .max_nodes = 32, .max_depth = 4, .max_memory = 4096, .max_steps = 16},
+};
+
+static void check_limits(char* input) {
+    ExprevalExpression* unlimited;
+    if (expreval_compile(input, NULL, &unlimited, NULL, 0) != EXPREVAL_OK) {
+        fprintf(stderr, "expreval_compile() rejected input \"%s\"\n", input);
+        abort();
+    }
+
+    float* variables = malloc(sizeof(float) * (expreval_variable_count(unlimited) + 1));
+    for (uint32_t i = 0; i < expreval_variable_count(unlimited); ++i) variables[i] = 0.5 + 0.75 * i;
+    float expected = expreval_evaluate(unlimited, variables);
+
+    for (size_t i = 0; i < sizeof(tight_limits) / sizeof(tight_limits[0]); ++i) {
+        ExprevalExpression* expression;
+        ExprevalStatus status = expreval_compile_limited(input, NULL, &tight_limits[i], &expression, NULL, 0);
+        if (status == EXPREVAL_OK) {
+            float actual = expreval_evaluate(expression, variables);
+            if (!values_match(expected, actual)) report(input, "expreval_compile_limited()", expected, actual);
+            expreval_free(expression);
+        } else if (status != EXPREVAL_LIMIT_EXCEEDED || expression != NULL) {
+            fprintf(stderr, "expreval_compile_limited() returned %d with limits %zu for input \"%s\"\n", status, i, input);
+            abort();
+        }
+    }
+
+    free(variables);
+    expreval_free(unlimited);
+}
+
+// Builds count times open, then middle and count times close.
+static char* build_chain(const char* open, uint32_t count, const char* middle, const char* close) {
+    size_t open_length = strlen(open);
+    size_t middle_length = strlen(middle);
+    size_t close_length = strlen(close);
+    char* output = malloc((open_length + close_length) * count + middle_length + 1);
+
+    char* cursor = output;
+    for (uint32_t i = 0; i < count; ++i, cursor += open_length) memcpy(cursor, open, open_length);
+    memcpy(cursor, middle, middle_length);
+    cursor += middle_length;
+    for (uint32_t i = 0; i < count; ++i, cursor += close_length) memcpy(cursor, close, close_length);
+    *cursor = '\0';
+    return output;
+}
+
+static void expect_status(char* what, char* input, const ExprevalLimits* limits, ExprevalStatus expected) {
+    ExprevalExpression* expression;
+    ExprevalStatus status = expreval_compile_limited(input, NULL, limits, &expression, NULL, 0);
+    if (status != expected) {
+        fprintf(stderr, "expreval_compile_limited() returned %d instead of %d for %s\n", status, expected, what);
+        abort();
+    }
+    if (expression != NULL) expreval_free(expression);
+}
+
+// Long chains must pass max_depth and go through every backend, see
+// compile_node(). Deep nesting must fail at max_depth or MAX_NESTING.
+static void check_long_chains() {
+    ExprevalLimits shallow = {.max_depth = 64};
+    ExprevalLimits few_nodes = {.max_nodes = 1000};
+
+    char* sum = build_chain("x+", CHAIN_LENGTH, "x", "");
+    expect_status("a long sum", sum, &shallow, EXPREVAL_OK);
+    expect_status("a long sum", sum, &few_nodes, EXPREVAL_LIMIT_EXCEEDED);
+    check_input(sum, NULL);
+    free(sum);
+
+    char* parentheses = build_chain("(", CHAIN_LENGTH, "x", "");
+    expect_status("deep parentheses", parentheses, &shallow, EXPREVAL_LIMIT_EXCEEDED);
+    expect_status("deep parentheses", parentheses, NULL, EXPREVAL_LIMIT_EXCEEDED);
+    free(parentheses);
+
+    char* powers = build_chain("x^", CHAIN_LENGTH, "x", "");
+    expect_status("a long power tower", powers, &shallow, EXPREVAL_LIMIT_EXCEEDED);
+    expect_status("a long power tower", powers, NULL, EXPREVAL_LIMIT_EXCEEDED);
+    free(powers);
+
+    // three levels per repetition, just below MAX_NESTING
+    char* nested = build_chain("(x^-", (MAX_NESTING - 1) / 3, "x", ")");
+    expect_status("nesting below the cap", nested, NULL, EXPREVAL_OK);
+    check_input(nested, NULL);
+    free(nested);
+}
+
+// Builds "(input)+(input)+..." with the given amount of copies.
+static char* repeat_input(char* input, uint32_t copies) {
+    size_t length = strlen(input);
+    char* output = malloc((length + 3) * copies + 1);
+
+    char* cursor = output;
+    for (uint32_t i = 0; i < copies; ++i) {
+        if (i > 0) *cursor++ = '+';
+        *cursor++ = '(';
+        memcpy(cursor, input, length);
+        cursor += length;
+        *cursor++ = ')';
+    }
+    *cursor = '\0';
+    return output;
+}
+
+static void check_input_scaling(char* input) {
+    uint64_t first[PHASE_COUNT];
+    uint64_t best[PHASE_COUNT];
+
+    for (uint32_t step = 0; step <= SCALING_STEPS; ++step) {
+        char* repeated = repeat_input(input, SCALING_START << step);
+
+        for (int phase = 0; phase < PHASE_COUNT; ++phase) best[phase] = UINT64_MAX;
+        for (uint32_t run = 0; run < SCALING_RUNS; ++run) {
+            uint64_t times[PHASE_COUNT];
+            if (!check_input(repeated, times)) {
+                // "(a)+(b)" must parse whenever "a" and "b" do
+                fprintf(stderr, "Repeated input rejected for input \"%s\"\n", input);
+                abort();
+            }
+            for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+                if (times[phase] < best[phase]) best[phase] = times[phase];
+            }
+        }
+        free(repeated);
+
+        if (step == 0) memcpy(first, best, sizeof(first));
+    }
+
+    // fit time = length^exponent between the shortest and the longest expression
+    for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+        if (best[phase] < SCALING_NOISE) continue;
+
+        double exponent = log2((double)best[phase] / fmax(first[phase], 1.0)) / SCALING_STEPS;
+        if (exponent > SCALING_LIMIT) {
+            fprintf(stderr, "Superlinear %s time for input \"%s\": %llu ns for %u copies, %llu ns for %u copies\n",
+                    phase_names[phase], input,
+                    (unsigned long long)first[phase], SCALING_START,
+                    (unsigned long long)best[phase], SCALING_START << SCALING_STEPS);
+            abort();
+        }
+    }
+}
+
+static void run_input(const uint8_t* data, size_t size) {
+    if (size > MAX_INPUT_SIZE) return;
+
+    char* input = malloc(size + 1);
+    memcpy(input, data, size);
+    input[size] = '\0';
+
+    if (check_input(input, NULL)) {
+        check_out_of_memory(input);
+        check_limits(input);
+        if (check_scaling) check_input_scaling(input);
+    }
+    free(input);
+}
+
+#ifdef FUZZ_WITH_LIBFUZZER
+
+int LLVMFuzzerInitialize(int* argc, char*** argv) {
+    (void)argc;
+    (void)argv;
+    char* scaling = getenv("CALC_FUZZ_SCALING");
+    check_scaling = scaling != NULL && strcmp(scaling, "1") == 0;
+    check_known_gradients();
+    check_long_chains();
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    run_input(data, size);
+    return 0;
+}
+
+#else
+
+typedef struct {
+    char* cursor;
+    char* end;
+    unsigned int seed;
+} Generator;
+
+static void emit_text(Generator* generator, const char* text) {
+    size_t length = strlen(text);
+    memcpy(generator->cursor, text, length);
+    generator->cursor += length;
+}
+
+// Appends a random well-formed expression. Near the end of the buffer only
+// leaves are generated, the caller leaves room for one leaf per open call.
+static void generate_expression(Generator* generator, uint32_t depth) {
+    static const char* leaves[] = {"x", "y", "z", "0", "1", "2", "0.5", "3", "-0", "9", "0.3", "1000"};
+    static const char* operators[] = {"+", "-", "*", "/", "^", "<", "<=", ">", ">=", "==", "!=", " and ", " or "};
+    static const char* exponents[] = {"2", "3", "-1", "-2", "0.5", "0", "7", "0.3"};
+
+    uint32_t choice = rand_r(&generator->seed) % 100;
+    if (depth == 0 || choice < 25 || generator->end - generator->cursor < 256) {
+        emit_text(generator, leaves[rand_r(&generator->seed) % 12]);
+    } else if (choice < 60) {
+        emit_text(generator, "(");
+        generate_expression(generator, depth - 1);
+        emit_text(generator, operators[rand_r(&generator->seed) % 13]);
+        generate_expression(generator, depth - 1);
+        emit_text(generator, ")");
+    } else if (choice < 67) {
+        emit_text(generator, choice < 63 ? "-" : "not ");
+        generate_expression(generator, depth - 1);
+    } else if (choice < 75) {
+        emit_text(generator, "(");
+        generate_expression(generator, depth - 1);
+        emit_text(generator, " ? ");
+        generate_expression(generator, depth - 1);
+        emit_text(generator, " : ");
+        generate_expression(generator, depth - 1);
+        emit_text(generator, ")");
+    } else if (choice < 88) {
+        bool clamp = choice >= 84;
+        emit_text(generator, clamp ? "clamp(" : choice < 80 ? "min(" : "max(");
+        generate_expression(generator, depth - 1);
+        emit_text(generator, ", ");
+        generate_expression(generator, depth - 1);
+        if (clamp) {
+            emit_text(generator, ", ");
+            generate_expression(generator, depth - 1);
+        }
+        emit_text(generator, ")");
+    } else {
+        emit_text(generator, "(");
+        generate_expression(generator, depth - 1);
+        emit_text(generator, ")^");
+        emit_text(generator, exponents[rand_r(&generator->seed) % 8]);
+    }
+}
+
+static void run_random(uint32_t count, unsigned int seed) {
+    char* input = malloc(MAX_INPUT_SIZE);
+    Generator generator = {.seed = seed};
+    for (uint32_t i = 0; i < count; ++i) {
+        generator.cursor = input;
+        generator.end = input + MAX_INPUT_SIZE;
+        generate_expression(&generator, 1 + rand_r(&generator.seed) % RANDOM_DEPTH);
+        run_input((uint8_t*)input, generator.cursor - input);
+    }
+    free(input);
+}
+
+static void run_file(FILE* file) {
+    uint8_t* data = malloc(MAX_INPUT_SIZE);
+    size_t size = fread(data, 1, MAX_INPUT_SIZE, file);
+    run_input(data, size);
+    free(data);
+}
+
+int main(int argc, char** argv) {
+    --argc; ++argv; // consume program name
+    check_known_gradients();
+    check_long_chains();
+
+    if (argc > 0 && strcmp(*argv, "--scaling") == 0) {
+        check_scaling = true;
+        --argc; ++argv;
+    }
+
+    if (argc > 0 && strcmp(*argv, "--random") == 0) {
+        uint32_t count = argc > 1 ? atoi(argv[1]) : 1000;
+        unsigned int seed = argc > 2 ? atoi(argv[2]) : 1;
+        run_random(count, seed);
+        return 0;
+    }
+
+    if (argc == 0) {
+        run_file(stdin);
+        return 0;
+    }
+
+    for (int i = 0; i < argc; ++i) {
+        FILE* file = fopen(argv[i], "rb");
+        if (file == NULL) {
+            fprintf(stderr, "Could not open %s\n", argv[i]);
+            return 1;
+        }
+        run_file(file);
+        fclose(file);
+    }
+    return 0;
+}
+
+#endif
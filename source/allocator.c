@@ -0,0 +1,49 @@
+#include "allocator.h"
+
+#include <stdlib.h>
+
+Allocator allocator_or_default(const Allocator* allocator) {
+    if (allocator == NULL) {
+        return (Allocator){
+            .allocate = NULL,
+            .release = NULL,
+            .context = NULL};
+    }
+    return *allocator;
+}
+
+void* allocate(const Allocator* allocator, size_t size) {
+    if (allocator->allocate == NULL) return malloc(size);
+    return allocator->allocate(allocator->context, size);
+}
+
+void release(const Allocator* allocator, void* pointer) {
+    if (pointer == NULL) return;
+    if (allocator->release == NULL) {
+        free(pointer);
+        return;
+    }
+    allocator->release(allocator->context, pointer);
+}
+
+static void* allocate_from_budget(void* context, size_t size) {
+    AllocationBudget* budget = context;
+    if (budget->limit != 0 && size > budget->limit - budget->used) {
+        budget->exceeded = true;
+        return NULL;
+    }
+    budget->used += size;
+    return allocate(&budget->inner, size);
+}
+
+static void release_to_budget(void* context, void* pointer) {
+    AllocationBudget* budget = context;
+    release(&budget->inner, pointer);
+}
+
+Allocator budget_allocator(AllocationBudget* budget) {
+    return (Allocator){
+        .allocate = allocate_from_budget,
+        .release = release_to_budget,
+        .context = budget};
+}
@@ -0,0 +1,32 @@
+#ifndef _ALLOCATOR_H
+#define _ALLOCATOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Memory callbacks supplied by an embedding application. A zeroed Allocator,
+// or a NULL Allocator* where one is accepted, uses malloc() and free().
+typedef struct {
+    void* (*allocate)(void* context, size_t size);
+    void (*release)(void* context, void* pointer);
+    void* context;
+} Allocator;
+
+// Caps the bytes handed out through another allocator. Like an arena, released
+// memory is not credited back, so the limit bounds all allocations made
+// through it.
+typedef struct {
+    Allocator inner;
+    size_t limit; // 0 for no limit
+    size_t used;
+    bool exceeded;
+} AllocationBudget;
+
+Allocator allocator_or_default(const Allocator* allocator);
+void* allocate(const Allocator* allocator, size_t size);
+void release(const Allocator* allocator, void* pointer);
+// Allocates through budget->inner, failing once budget->limit would be passed.
+// Memory from it may be released through budget->inner directly.
+Allocator budget_allocator(AllocationBudget* budget);
+
+#endif // _ALLOCATOR_H
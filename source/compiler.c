@@ -0,0 +1,495 @@
+#include "compiler.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parser.h"
+
+#define LOCAL_STACK_SIZE 64
+#define BATCH_SIZE 64 // rows evaluated together by run_program_batch()
+#define MAX_INTEGER_EXPONENT 64 // larger literal exponents still go through pow()
+
+typedef struct {
+    Program* program;
+    uint32_t depth;
+    Node** spine;          // nodes waiting for their first operand, see compile_node()
+    uint32_t spine_length;
+    bool failed; // out of memory
+} Compiler;
+
+// Follows first children iteratively, see compile_node()
+static uint32_t count_nodes(Node* node) {
+    uint32_t count = 1;
+    for (; node_child_count(node->kind) > 0; node = node_child(node, 0)) {
+        for (uint32_t i = 1; i < node_child_count(node->kind); ++i) {
+            count += count_nodes(node_child(node, i));
+        }
+        ++count;
+    }
+    return count;
+}
+
+static OpKind node_op_kind(NodeKind kind) {
+    switch (kind) {
+        case NODE_KIND_ADD: return OP_KIND_ADD;
+        case NODE_KIND_SUBTRACT: return OP_KIND_SUBTRACT;
+        case NODE_KIND_MULTIPLY: return OP_KIND_MULTIPLY;
+        case NODE_KIND_DIVIDE: return OP_KIND_DIVIDE;
+        case NODE_KIND_POW: return OP_KIND_POW;
+        case NODE_KIND_MINUS: return OP_KIND_MINUS;
+        case NODE_KIND_LESS: return OP_KIND_LESS;
+        case NODE_KIND_LESS_EQUAL: return OP_KIND_LESS_EQUAL;
+        case NODE_KIND_GREATER: return OP_KIND_GREATER;
+        case NODE_KIND_GREATER_EQUAL: return OP_KIND_GREATER_EQUAL;
+        case NODE_KIND_EQUAL: return OP_KIND_EQUAL;
+        case NODE_KIND_NOT_EQUAL: return OP_KIND_NOT_EQUAL;
+        case NODE_KIND_AND: return OP_KIND_AND;
+        case NODE_KIND_OR: return OP_KIND_OR;
+        case NODE_KIND_NOT: return OP_KIND_NOT;
+        case NODE_KIND_CONDITIONAL: return OP_KIND_SELECT;
+        case NODE_KIND_MIN: return OP_KIND_MIN;
+        case NODE_KIND_MAX: return OP_KIND_MAX;
+        case NODE_KIND_CLAMP: return OP_KIND_CLAMP;
+        case NODE_KIND_NUMBER: return OP_KIND_CONSTANT;
+        case NODE_KIND_VARIABLE: return OP_KIND_VARIABLE;
+    }
+    return OP_KIND_CONSTANT;
+}
+
+uint32_t op_operand_count(OpKind kind) {
+    switch (kind) {
+        case OP_KIND_CONSTANT:
+        case OP_KIND_VARIABLE:
+            return 0;
+        case OP_KIND_MINUS:
+        case OP_KIND_NOT:
+        case OP_KIND_POWI:
+        case OP_KIND_SQRT:
+            return 1;
+        case OP_KIND_SELECT:
+        case OP_KIND_CLAMP:
+            return 3;
+        default:
+            return 2;
+    }
+}
+
+// program->variables has room for one name per node, so it never grows
+static uint32_t intern_variable(Compiler* compiler, char* name) {
+    Program* program = compiler->program;
+    int32_t index = program_variable_index(program, name);
+    if (index >= 0) return (uint32_t)index;
+
+    char* copy = allocate(&program->allocator, strlen(name) + 1);
+    if (copy == NULL) {
+        compiler->failed = true;
+        return 0;
+    }
+    strcpy(copy, name);
+    program->variables[program->variable_count] = copy;
+
+    return program->variable_count++;
+}
+
+static void emit(Compiler* compiler, Instruction instruction, uint32_t operands) {
+    Program* program = compiler->program;
+    program->code[program->length++] = instruction;
+
+    compiler->depth = compiler->depth - operands + 1;
+    if (compiler->depth > program->stack_size) {
+        program->stack_size = compiler->depth;
+    }
+}
+
+// Value of a literal exponent, negated literals included
+static bool constant_exponent(Node* node, float* exponent) {
+    if (node->kind == NODE_KIND_NUMBER) {
+        *exponent = *(float*)node->value;
+        return true;
+    }
+    if (node->kind == NODE_KIND_MINUS && ((Node*)node->value)->kind == NODE_KIND_NUMBER) {
+        *exponent = *(float*)((Node*)node->value)->value * -1.0;
+        return true;
+    }
+    return false;
+}
+
+static void compile_node(Compiler* compiler, Node* node);
+
+// Emits the rest of node once its first operand is on the stack
+static void finish_node(Compiler* compiler, Node* node) {
+    if (node->kind == NODE_KIND_POW) {
+        Node* exponent_node = node_child(node, 1);
+        float exponent = 0.0;
+        bool literal = constant_exponent(exponent_node, &exponent);
+
+        if (literal && exponent == 0.5) {
+            emit(compiler, (Instruction){.kind = OP_KIND_SQRT}, 1);
+        } else if (literal && fabsf(exponent) <= MAX_INTEGER_EXPONENT && exponent == (int32_t)exponent) {
+            emit(compiler, (Instruction){.kind = OP_KIND_POWI, .exponent = (int32_t)exponent}, 1);
+        } else {
+            compile_node(compiler, exponent_node);
+            emit(compiler, (Instruction){.kind = OP_KIND_POW}, 2);
+        }
+        return;
+    }
+
+    uint32_t children = node_child_count(node->kind);
+    for (uint32_t i = 1; i < children; ++i) {
+        compile_node(compiler, node_child(node, i));
+    }
+    emit(compiler, (Instruction){.kind = node_op_kind(node->kind)}, children);
+}
+
+// First operands are followed in a loop, their nodes wait on the spine until
+// the leaf at the bottom is emitted. Left-leaning chains like x + x + ... + x
+// are parsed by loops and don't count towards max_depth or MAX_NESTING, so
+// no walk over the tree may recurse once per operator. Only the other
+// operands recurse, and their nesting is bounded by the parser.
+static void compile_node(Compiler* compiler, Node* node) {
+    uint32_t bottom = compiler->spine_length;
+    for (; node_child_count(node->kind) > 0; node = node_child(node, 0)) {
+        compiler->spine[compiler->spine_length++] = node;
+    }
+
+    if (node->kind == NODE_KIND_NUMBER) {
+        emit(compiler, (Instruction){.kind = OP_KIND_CONSTANT, .constant = *(float*)node->value}, 0);
+    } else {
+        uint32_t index = intern_variable(compiler, (char*)node->value);
+        emit(compiler, (Instruction){.kind = OP_KIND_VARIABLE, .variable = index}, 0);
+    }
+
+    while (compiler->spine_length > bottom) {
+        finish_node(compiler, compiler->spine[--compiler->spine_length]);
+    }
+}
+
+Program* compile(Node* root, const Allocator* allocator) {
+    Allocator chosen = allocator_or_default(allocator);
+    Program* program = allocate(&chosen, sizeof(Program));
+    if (program == NULL) return NULL;
+
+    uint32_t capacity = root == NULL ? 1 : count_nodes(root);
+    *program = (Program){
+        .allocator = chosen,
+        .code = allocate(&chosen, sizeof(Instruction) * capacity),
+        .length = 0,
+        .stack_size = 0,
+        .variables = allocate(&chosen, sizeof(char*) * capacity),
+        .variable_count = 0};
+
+    // every node is on the spine at most once
+    Node** spine = allocate(&chosen, sizeof(Node*) * capacity);
+    if (program->code == NULL || program->variables == NULL || spine == NULL) {
+        release(&chosen, spine);
+        free_program(program);
+        return NULL;
+    }
+
+    Compiler compiler = {.program = program, .depth = 0, .spine = spine, .spine_length = 0, .failed = false};
+    if (root == NULL) {
+        // an empty expression interprets to 0
+        emit(&compiler, (Instruction){.kind = OP_KIND_CONSTANT, .constant = 0.0}, 0);
+    } else {
+        compile_node(&compiler, root);
+    }
+    release(&chosen, spine);
+
+    if (compiler.failed) {
+        free_program(program);
+        return NULL;
+    }
+    return program;
+}
+
+int32_t program_variable_index(const Program* program, const char* name) {
+    for (uint32_t i = 0; i < program->variable_count; ++i) {
+        if (strcmp(program->variables[i], name) == 0) return (int32_t)i;
+    }
+    return -1;
+}
+
+float run_program(const Program* program, const float* variables) {
+    float local_stack[LOCAL_STACK_SIZE];
+    float* stack = local_stack;
+    if (program->stack_size > LOCAL_STACK_SIZE) {
+        stack = allocate(&program->allocator, sizeof(float) * program->stack_size);
+        if (stack == NULL) return NAN;
+    }
+
+    uint32_t top = 0;  // index one past the top of the stack
+    for (uint32_t i = 0; i < program->length; ++i) {
+        const Instruction* instruction = &program->code[i];
+        switch (instruction->kind) {
+            case OP_KIND_CONSTANT:
+                stack[top++] = instruction->constant;
+                break;
+            case OP_KIND_VARIABLE:
+                stack[top++] = variables[instruction->variable];
+                break;
+            case OP_KIND_MINUS:
+            case OP_KIND_NOT:
+            case OP_KIND_SQRT:
+                stack[top - 1] = apply_operation(instruction->kind, stack[top - 1], 0.0, 0.0);
+                break;
+            case OP_KIND_POWI:
+                stack[top - 1] = power_integer(stack[top - 1], instruction->exponent);
+                break;
+            case OP_KIND_SELECT:
+            case OP_KIND_CLAMP:
+                top -= 2;
+                stack[top - 1] = apply_operation(instruction->kind, stack[top - 1], stack[top], stack[top + 1]);
+                break;
+            default:
+                --top;
+                stack[top - 1] = apply_operation(instruction->kind, stack[top - 1], stack[top], 0.0);
+                break;
+        }
+    }
+
+    float result = top > 0 ? stack[top - 1] : 0.0;
+    if (stack != local_stack) release(&program->allocator, stack);
+    return result;
+}
+
+// Runs one instruction at a time over a block of rows, so every case below is
+// a plain loop over contiguous floats that the compiler can vectorize. The
+// conditional ones are selects, not branches, so they vectorize as well.
+static void run_program_block(const Program* program, const float* variables, uint32_t rows, float* stack, float* results) {
+    uint32_t top = 0;  // index one past the top of the stack, in columns of BATCH_SIZE
+    for (uint32_t i = 0; i < program->length; ++i) {
+        const Instruction* instruction = &program->code[i];
+        switch (instruction->kind) {
+            case OP_KIND_CONSTANT: {
+                float* a = &stack[BATCH_SIZE * top++];
+                for (uint32_t r = 0; r < rows; ++r) a[r] = instruction->constant;
+                break;
+            }
+            case OP_KIND_VARIABLE: {
+                float* a = &stack[BATCH_SIZE * top++];
+                for (uint32_t r = 0; r < rows; ++r) a[r] = variables[r * program->variable_count + instruction->variable];
+                break;
+            }
+            case OP_KIND_ADD: {
+                --top;
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                float* b = &stack[BATCH_SIZE * top];
+                for (uint32_t r = 0; r < rows; ++r) a[r] = a[r] + b[r];
+                break;
+            }
+            case OP_KIND_SUBTRACT: {
+                --top;
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                float* b = &stack[BATCH_SIZE * top];
+                for (uint32_t r = 0; r < rows; ++r) a[r] = a[r] - b[r];
+                break;
+            }
+            case OP_KIND_MULTIPLY: {
+                --top;
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                float* b = &stack[BATCH_SIZE * top];
+                for (uint32_t r = 0; r < rows; ++r) a[r] = a[r] * b[r];
+                break;
+            }
+            case OP_KIND_DIVIDE: {
+                --top;
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                float* b = &stack[BATCH_SIZE * top];
+                for (uint32_t r = 0; r < rows; ++r) a[r] = a[r] / b[r];
+                break;
+            }
+            case OP_KIND_POW: {
+                --top;
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                float* b = &stack[BATCH_SIZE * top];
+                for (uint32_t r = 0; r < rows; ++r) a[r] = pow(a[r], b[r]);
+                break;
+            }
+            case OP_KIND_LESS: {
+                --top;
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                float* b = &stack[BATCH_SIZE * top];
+                for (uint32_t r = 0; r < rows; ++r) a[r] = a[r] < b[r] ? 1.0f : 0.0f;
+                break;
+            }
+            case OP_KIND_LESS_EQUAL: {
+                --top;
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                float* b = &stack[BATCH_SIZE * top];
+                for (uint32_t r = 0; r < rows; ++r) a[r] = a[r] <= b[r] ? 1.0f : 0.0f;
+                break;
+            }
+            case OP_KIND_GREATER: {
+                --top;
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                float* b = &stack[BATCH_SIZE * top];
+                for (uint32_t r = 0; r < rows; ++r) a[r] = a[r] > b[r] ? 1.0f : 0.0f;
+                break;
+            }
+            case OP_KIND_GREATER_EQUAL: {
+                --top;
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                float* b = &stack[BATCH_SIZE * top];
+                for (uint32_t r = 0; r < rows; ++r) a[r] = a[r] >= b[r] ? 1.0f : 0.0f;
+                break;
+            }
+            case OP_KIND_EQUAL: {
+                --top;
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                float* b = &stack[BATCH_SIZE * top];
+                for (uint32_t r = 0; r < rows; ++r) a[r] = a[r] == b[r] ? 1.0f : 0.0f;
+                break;
+            }
+            case OP_KIND_NOT_EQUAL: {
+                --top;
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                float* b = &stack[BATCH_SIZE * top];
+                for (uint32_t r = 0; r < rows; ++r) a[r] = a[r] != b[r] ? 1.0f : 0.0f;
+                break;
+            }
+            case OP_KIND_AND: {
+                --top;
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                float* b = &stack[BATCH_SIZE * top];
+                for (uint32_t r = 0; r < rows; ++r) a[r] = (a[r] != 0.0f) & (b[r] != 0.0f);  // no branch, so it vectorizes
+                break;
+            }
+            case OP_KIND_OR: {
+                --top;
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                float* b = &stack[BATCH_SIZE * top];
+                for (uint32_t r = 0; r < rows; ++r) a[r] = (a[r] != 0.0f) | (b[r] != 0.0f);
+                break;
+            }
+            case OP_KIND_MIN: {
+                --top;
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                float* b = &stack[BATCH_SIZE * top];
+                for (uint32_t r = 0; r < rows; ++r) a[r] = a[r] < b[r] ? a[r] : b[r];
+                break;
+            }
+            case OP_KIND_MAX: {
+                --top;
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                float* b = &stack[BATCH_SIZE * top];
+                for (uint32_t r = 0; r < rows; ++r) a[r] = a[r] > b[r] ? a[r] : b[r];
+                break;
+            }
+            case OP_KIND_MINUS: {
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                for (uint32_t r = 0; r < rows; ++r) a[r] = a[r] * -1.0f;
+                break;
+            }
+            case OP_KIND_NOT: {
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                for (uint32_t r = 0; r < rows; ++r) a[r] = a[r] == 0.0f ? 1.0f : 0.0f;
+                break;
+            }
+            case OP_KIND_POWI: {
+                // power_integer() with the loop over exponent bits outside the
+                // loop over rows, the exponent is the same for every row
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                double square[BATCH_SIZE];
+                double result[BATCH_SIZE];
+                for (uint32_t r = 0; r < rows; ++r) {
+                    square[r] = a[r];
+                    result[r] = 1.0;
+                }
+                int32_t exponent = instruction->exponent;
+                for (uint32_t n = exponent < 0 ? -(uint32_t)exponent : (uint32_t)exponent; n != 0; n >>= 1) {
+                    if (n & 1) {
+                        for (uint32_t r = 0; r < rows; ++r) result[r] *= square[r];
+                    }
+                    for (uint32_t r = 0; r < rows; ++r) square[r] *= square[r];
+                }
+                if (exponent < 0) {
+                    for (uint32_t r = 0; r < rows; ++r) a[r] = 1.0 / result[r];
+                } else {
+                    for (uint32_t r = 0; r < rows; ++r) a[r] = result[r];
+                }
+                break;
+            }
+            case OP_KIND_SQRT: {
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                for (uint32_t r = 0; r < rows; ++r) a[r] = a[r] == -INFINITY ? INFINITY : fabsf(sqrtf(a[r]));
+                break;
+            }
+            case OP_KIND_SELECT: {
+                top -= 2;
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                float* b = &stack[BATCH_SIZE * top];
+                float* c = &stack[BATCH_SIZE * (top + 1)];
+                for (uint32_t r = 0; r < rows; ++r) {
+                    // both loaded unconditionally, so this is a blend instead of a branch
+                    float then = b[r], otherwise = c[r];
+                    a[r] = a[r] != 0.0f ? then : otherwise;
+                }
+                break;
+            }
+            case OP_KIND_CLAMP: {
+                top -= 2;
+                float* a = &stack[BATCH_SIZE * (top - 1)];
+                float* b = &stack[BATCH_SIZE * top];
+                float* c = &stack[BATCH_SIZE * (top + 1)];
+                for (uint32_t r = 0; r < rows; ++r) {
+                    float low = a[r] < b[r] ? b[r] : a[r];
+                    a[r] = low > c[r] ? c[r] : low;
+                }
+                break;
+            }
+        }
+    }
+
+    memcpy(results, stack, sizeof(float) * rows);
+}
+
+bool run_program_batch(const Program* program, const float* variables, uint32_t count, float* results) {
+    float* stack = allocate(&program->allocator, sizeof(float) * BATCH_SIZE * program->stack_size);
+    if (stack == NULL) return false;
+
+    for (uint32_t row = 0; row < count; row += BATCH_SIZE) {
+        uint32_t rows = count - row < BATCH_SIZE ? count - row : BATCH_SIZE;
+        run_program_block(program, &variables[(size_t)row * program->variable_count], rows, stack, &results[row]);
+    }
+
+    release(&program->allocator, stack);
+    return true;
+}
+
+void free_program(Program* program) {
+    Allocator allocator = program->allocator;
+    for (uint32_t i = 0; i < program->variable_count; ++i) {
+        release(&allocator, program->variables[i]);
+    }
+    release(&allocator, program->variables);
+    release(&allocator, program->code);
+    release(&allocator, program);
+}
+
+static const char* op_names[] = {
+    "constant", "variable", "add", "subtract", "multiply", "divide", "pow", "minus",
+    "less", "less_equal", "greater", "greater_equal", "equal", "not_equal",
+    "and", "or", "not", "select", "min", "max", "clamp", "powi", "sqrt",
+};
+
+void print_program(const Program* program) {
+    for (uint32_t i = 0; i < program->length; ++i) {
+        const Instruction* instruction = &program->code[i];
+        switch (instruction->kind) {
+            case OP_KIND_CONSTANT:
+                printf("%4u: constant %f\n", i, instruction->constant);
+                break;
+            case OP_KIND_VARIABLE:
+                printf("%4u: variable %s\n", i, program->variables[instruction->variable]);
+                break;
+            case OP_KIND_POWI:
+                printf("%4u: powi %d\n", i, instruction->exponent);
+                break;
+            default:
+                printf("%4u: %s\n", i, op_names[instruction->kind]);
+                break;
+        }
+    }
+}
@@ -0,0 +1,122 @@
+#ifndef _COMPILER_H
+#define _COMPILER_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "allocator.h"
+#include "parser.h"
+
+// Flat postfix form of a Node tree. Every instruction pushes exactly one value
+// onto an evaluation stack, popping its operands first.
+//
+// Conditionals compile to OP_KIND_SELECT, which evaluates both branches and
+// picks one afterwards, so evaluation never branches on the data.
+//
+// Powers with a literal exponent skip pow(): small integers compile to
+// OP_KIND_POWI and 0.5 to OP_KIND_SQRT.
+typedef enum {
+    OP_KIND_CONSTANT,      // 0
+    OP_KIND_VARIABLE,      // 1
+    OP_KIND_ADD,           // 2
+    OP_KIND_SUBTRACT,      // 3
+    OP_KIND_MULTIPLY,      // 4
+    OP_KIND_DIVIDE,        // 5
+    OP_KIND_POW,           // 6
+    OP_KIND_MINUS,         // 7
+    OP_KIND_LESS,          // 8
+    OP_KIND_LESS_EQUAL,    // 9
+    OP_KIND_GREATER,       // 10
+    OP_KIND_GREATER_EQUAL, // 11
+    OP_KIND_EQUAL,         // 12
+    OP_KIND_NOT_EQUAL,     // 13
+    OP_KIND_AND,           // 14
+    OP_KIND_OR,            // 15
+    OP_KIND_NOT,           // 16
+    OP_KIND_SELECT,        // 17, condition, a, b
+    OP_KIND_MIN,           // 18
+    OP_KIND_MAX,           // 19
+    OP_KIND_CLAMP,         // 20, x, low, high
+    OP_KIND_POWI,          // 21, x, exponent stored in the instruction
+    OP_KIND_SQRT,          // 22
+} OpKind;
+
+typedef struct {
+    OpKind kind;
+    union {
+        float constant;    // OP_KIND_CONSTANT
+        uint32_t variable; // OP_KIND_VARIABLE, index into Program.variables
+        int32_t exponent;  // OP_KIND_POWI
+    };
+} Instruction;
+
+typedef struct {
+    Allocator allocator; // owns everything below, also used for evaluation scratch memory
+
+    Instruction* code;
+    uint32_t length;
+    uint32_t stack_size; // deepest the evaluation stack gets
+
+    // variable names in order of first appearance, values are passed in this order
+    char** variables;
+    uint32_t variable_count;
+} Program;
+
+uint32_t op_operand_count(OpKind kind);
+
+// x^exponent by square-and-multiply, a negative exponent takes the reciprocal.
+// Works in double like pow(), so an intermediate power beyond float range
+// doesn't turn a representable result into 0 or inf.
+static inline float power_integer(float x, int32_t exponent) {
+    uint32_t n = exponent < 0 ? -(uint32_t)exponent : (uint32_t)exponent;
+    double result = 1.0;
+    for (double square = x; n != 0; n >>= 1, square *= square) {
+        if (n & 1) result *= square;
+    }
+    return exponent < 0 ? 1.0 / result : result;
+}
+
+// Value of an instruction other than OP_KIND_CONSTANT, OP_KIND_VARIABLE and
+// OP_KIND_POWI, unused operands are ignored. Every evaluator follows these definitions.
+static inline float apply_operation(OpKind kind, float a, float b, float c) {
+    switch (kind) {
+        case OP_KIND_ADD: return a + b;
+        case OP_KIND_SUBTRACT: return a - b;
+        case OP_KIND_MULTIPLY: return a * b;
+        case OP_KIND_DIVIDE: return a / b;
+        case OP_KIND_POW: return pow(a, b);
+        case OP_KIND_MINUS: return a * -1.0;
+        case OP_KIND_LESS: return a < b ? 1.0 : 0.0;
+        case OP_KIND_LESS_EQUAL: return a <= b ? 1.0 : 0.0;
+        case OP_KIND_GREATER: return a > b ? 1.0 : 0.0;
+        case OP_KIND_GREATER_EQUAL: return a >= b ? 1.0 : 0.0;
+        case OP_KIND_EQUAL: return a == b ? 1.0 : 0.0;
+        case OP_KIND_NOT_EQUAL: return a != b ? 1.0 : 0.0;
+        case OP_KIND_AND: return a != 0.0 && b != 0.0 ? 1.0 : 0.0;
+        case OP_KIND_OR: return a != 0.0 || b != 0.0 ? 1.0 : 0.0;
+        case OP_KIND_NOT: return a == 0.0 ? 1.0 : 0.0;
+        case OP_KIND_SELECT: return a != 0.0 ? b : c;
+        case OP_KIND_MIN: return a < b ? a : b;
+        case OP_KIND_MAX: return a > b ? a : b;
+        case OP_KIND_CLAMP: {
+            float low = a < b ? b : a;
+            return low > c ? c : low;
+        }
+        // pow(a, 0.5) differs from sqrtf(a) at -0 and -inf, which give +0 and +inf
+        case OP_KIND_SQRT: return a == -INFINITY ? INFINITY : fabsf(sqrtf(a));
+        default: return 0.0;
+    }
+}
+
+// Returns NULL when out of memory. The program does not reference the tree.
+Program* compile(Node* root, const Allocator* allocator);
+int32_t program_variable_index(const Program* program, const char* name);
+float run_program(const Program* program, const float* variables);
+// variables holds count rows of variable_count values each, one result per row.
+// Returns false when out of memory.
+bool run_program_batch(const Program* program, const float* variables, uint32_t count, float* results);
+void free_program(Program* program);
+void print_program(const Program* program);
+
+#endif // _COMPILER_H
@@ -0,0 +1,251 @@
+#include "differentiate.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "compiler.h"
+
+// Both modes apply the chain rule with the same partials in plain IEEE
+// arithmetic, so an infinite partial times a zero tangent or adjoint is NaN in
+// either. The only contributions left out are structural ones: forward mode
+// skips operands that don't depend on the variable at all, and reverse mode
+// skips instructions that don't reach the result. Comparisons, logic and the
+// operands a selection didn't pick have no derivative, so they cut both.
+
+// d(a^b)/db, only defined for a positive base. Returning 0 otherwise keeps a
+// constant exponent from turning the other partials into NaN.
+static float pow_exponent_partial(float a, float result) {
+    return a > 0.0 ? result * logf(a) : 0.0;
+}
+
+// d(x^exponent)/dx for OP_KIND_POWI, x^0 is constant even at x = 0
+static float powi_partial(float x, int32_t exponent) {
+    return exponent == 0 ? 0.0 : exponent * power_integer(x, exponent - 1);
+}
+
+static float instruction_value(const Instruction* instruction, float a, float b, float c) {
+    if (instruction->kind == OP_KIND_POWI) return power_integer(a, instruction->exponent);
+    return apply_operation(instruction->kind, a, b, c);
+}
+
+// Whether the chain rule goes through the partials below, the other
+// instructions are constants, variables, selections or piecewise constant.
+static bool has_partials(OpKind kind) {
+    switch (kind) {
+        case OP_KIND_ADD:
+        case OP_KIND_SUBTRACT:
+        case OP_KIND_MULTIPLY:
+        case OP_KIND_DIVIDE:
+        case OP_KIND_POW:
+        case OP_KIND_MINUS:
+        case OP_KIND_POWI:
+        case OP_KIND_SQRT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Partial derivatives of value with respect to the operands a and b, for the
+// instructions has_partials() accepts. Unary ones leave *db at 0.
+static void partials(const Instruction* instruction, float a, float b, float value, float* da, float* db) {
+    *db = 0.0;
+    switch (instruction->kind) {
+        case OP_KIND_ADD: *da = 1.0; *db = 1.0; break;
+        case OP_KIND_SUBTRACT: *da = 1.0; *db = -1.0; break;
+        case OP_KIND_MULTIPLY: *da = b; *db = a; break;
+        case OP_KIND_DIVIDE: *da = 1.0 / b; *db = -value / b; break;
+        case OP_KIND_POW:
+            *da = b * pow(a, b - 1.0);
+            *db = pow_exponent_partial(a, value);
+            break;
+        case OP_KIND_MINUS: *da = -1.0; break;
+        case OP_KIND_POWI: *da = powi_partial(a, instruction->exponent); break;
+        case OP_KIND_SQRT: *da = 0.5 / value; break;
+        default: *da = 0.0; break;
+    }
+}
+
+// Index of the operand that OP_KIND_SELECT, OP_KIND_MIN, OP_KIND_MAX and
+// OP_KIND_CLAMP pass through, the derivative comes only from that operand.
+static uint32_t chosen_operand(OpKind kind, float a, float b, float c) {
+    switch (kind) {
+        case OP_KIND_SELECT:
+            return a != 0.0 ? 1 : 2;
+        case OP_KIND_MIN:
+            return a < b ? 0 : 1;
+        case OP_KIND_MAX:
+            return a > b ? 0 : 1;
+        case OP_KIND_CLAMP: {
+            uint32_t low = a < b ? 1 : 0;
+            float value = low == 1 ? b : a;
+            return value > c ? 2 : low;
+        }
+        default:
+            return 0;
+    }
+}
+
+static bool is_selection(OpKind kind) {
+    return kind == OP_KIND_SELECT || kind == OP_KIND_MIN || kind == OP_KIND_MAX || kind == OP_KIND_CLAMP;
+}
+
+float evaluate_forward(const Program* program, const float* variables, float* gradient) {
+    uint32_t n = program->variable_count;
+    uint32_t width = n + 1;  // value followed by its tangents
+    float* stack = allocate(&program->allocator, sizeof(float) * width * program->stack_size);
+    // per slot and variable, whether the value depends on the variable at all
+    bool* depends = allocate(&program->allocator, sizeof(bool) * (n + 1) * program->stack_size);
+    float result = NAN;
+    if (stack == NULL || depends == NULL) goto cleanup;
+
+    uint32_t top = 0;
+    for (uint32_t i = 0; i < program->length; ++i) {
+        const Instruction* instruction = &program->code[i];
+        if (instruction->kind == OP_KIND_CONSTANT || instruction->kind == OP_KIND_VARIABLE) {
+            float* slot = &stack[width * top];
+            bool* slot_depends = &depends[n * top];
+            ++top;
+            memset(slot, 0, sizeof(float) * width);
+            memset(slot_depends, 0, sizeof(bool) * n);
+            if (instruction->kind == OP_KIND_CONSTANT) {
+                slot[0] = instruction->constant;
+            } else {
+                slot[0] = variables[instruction->variable];
+                slot[1 + instruction->variable] = 1.0;
+                slot_depends[instruction->variable] = true;
+            }
+            continue;
+        }
+
+        uint32_t count = op_operand_count(instruction->kind);
+        top -= count - 1;
+        float* a = &stack[width * (top - 1)];
+        bool* a_depends = &depends[n * (top - 1)];
+        float b = count > 1 ? a[width] : 0.0;
+        float c = count > 2 ? a[2 * width] : 0.0;
+
+        if (is_selection(instruction->kind)) {
+            uint32_t chosen = chosen_operand(instruction->kind, a[0], b, c);
+            if (chosen != 0) {
+                memcpy(a, &a[width * chosen], sizeof(float) * width);
+                memcpy(a_depends, &a_depends[n * chosen], sizeof(bool) * n);
+            }
+        } else if (has_partials(instruction->kind)) {
+            float value = instruction_value(instruction, a[0], b, c);
+            float da, db;
+            partials(instruction, a[0], b, value, &da, &db);
+
+            float* b_tangents = count > 1 ? &a[width + 1] : NULL;
+            bool* b_depends = count > 1 ? &a_depends[n] : NULL;
+            for (uint32_t k = 0; k < n; ++k) {
+                float tangent = a_depends[k] ? da * a[1 + k] : 0.0;
+                if (b_depends != NULL && b_depends[k]) {
+                    tangent += db * b_tangents[k];
+                    a_depends[k] = true;
+                }
+                a[1 + k] = tangent;
+            }
+            a[0] = value;
+        } else {
+            a[0] = instruction_value(instruction, a[0], b, c);
+            memset(&a[1], 0, sizeof(float) * n);
+            memset(a_depends, 0, sizeof(bool) * n);
+        }
+    }
+
+    result = stack[0];
+    memcpy(gradient, &stack[1], sizeof(float) * n);
+
+cleanup:
+    release(&program->allocator, stack);
+    release(&program->allocator, depends);
+    return result;
+}
+
+float evaluate_reverse(const Program* program, const float* variables, float* gradient) {
+    uint32_t length = program->length;
+
+    // per instruction: its value, its adjoint, whether it reaches the result
+    // and the instructions producing its operands
+    const Allocator* allocator = &program->allocator;
+    float* values = allocate(allocator, sizeof(float) * length);
+    float* adjoints = allocate(allocator, sizeof(float) * length);
+    bool* reached = allocate(allocator, sizeof(bool) * length);
+    uint32_t* operands = allocate(allocator, sizeof(uint32_t) * 3 * length);
+    uint32_t* stack = allocate(allocator, sizeof(uint32_t) * program->stack_size);
+
+    float result = NAN;
+    if (values == NULL || adjoints == NULL || reached == NULL || operands == NULL || stack == NULL) goto cleanup;
+
+    // forward sweep, the stack holds instruction indices instead of values
+    uint32_t top = 0;
+    for (uint32_t i = 0; i < length; ++i) {
+        const Instruction* instruction = &program->code[i];
+        uint32_t* used = &operands[3 * i];
+        switch (instruction->kind) {
+            case OP_KIND_CONSTANT:
+                values[i] = instruction->constant;
+                break;
+            case OP_KIND_VARIABLE:
+                values[i] = variables[instruction->variable];
+                break;
+            default: {
+                uint32_t count = op_operand_count(instruction->kind);
+                float operand_values[3] = {0.0, 0.0, 0.0};
+                for (uint32_t k = count; k-- > 0;) {
+                    used[k] = stack[--top];
+                    operand_values[k] = values[used[k]];
+                }
+                values[i] = instruction_value(instruction, operand_values[0], operand_values[1], operand_values[2]);
+                break;
+            }
+        }
+        stack[top++] = i;
+    }
+
+    // reverse sweep, operands always come before the instruction using them
+    memset(adjoints, 0, sizeof(float) * length);
+    memset(reached, 0, sizeof(bool) * length);
+    memset(gradient, 0, sizeof(float) * program->variable_count);
+    adjoints[length - 1] = 1.0;
+    reached[length - 1] = true;
+
+    for (uint32_t i = length; i-- > 0;) {
+        const Instruction* instruction = &program->code[i];
+        const uint32_t* used = &operands[3 * i];
+        float adjoint = adjoints[i];
+        if (!reached[i]) continue;
+
+        if (instruction->kind == OP_KIND_VARIABLE) {
+            gradient[instruction->variable] += adjoint;
+        } else if (is_selection(instruction->kind)) {
+            float c = op_operand_count(instruction->kind) > 2 ? values[used[2]] : 0.0;
+            uint32_t chosen = chosen_operand(instruction->kind, values[used[0]], values[used[1]], c);
+            adjoints[used[chosen]] += adjoint;
+            reached[used[chosen]] = true;
+        } else if (has_partials(instruction->kind)) {
+            bool binary = op_operand_count(instruction->kind) > 1;
+            float da, db;
+            partials(instruction, values[used[0]], binary ? values[used[1]] : 0.0, values[i], &da, &db);
+            adjoints[used[0]] += da * adjoint;
+            reached[used[0]] = true;
+            if (binary) {
+                adjoints[used[1]] += db * adjoint;
+                reached[used[1]] = true;
+            }
+        }
+        // constants, comparisons and logic don't pass anything on
+    }
+
+    result = values[length - 1];
+
+cleanup:
+    release(allocator, values);
+    release(allocator, adjoints);
+    release(allocator, reached);
+    release(allocator, operands);
+    release(allocator, stack);
+    return result;
+}
@@ -0,0 +1,18 @@
+#ifndef _DIFFERENTIATE_H
+#define _DIFFERENTIATE_H
+
+#include "compiler.h"
+
+// Both functions evaluate the program like run_program() and additionally write
+// the partial derivative with respect to every variable into gradient, which must
+// hold program->variable_count floats. When out of memory they return NAN.
+
+// Forward mode: carries a dual number with one tangent per variable through the
+// stack. Cost grows with length * variable_count, best for few variables.
+float evaluate_forward(const Program* program, const float* variables, float* gradient);
+
+// Reverse mode: records every intermediate value on a tape, then sweeps it
+// backwards accumulating adjoints. Cost grows with length only.
+float evaluate_reverse(const Program* program, const float* variables, float* gradient);
+
+#endif // _DIFFERENTIATE_H
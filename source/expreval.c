@@ -0,0 +1,160 @@
+#include "expreval.h"
+
+#include <stdio.h>
+
+#include "allocator.h"
+#include "compiler.h"
+#include "differentiate.h"
+#include "parser.h"
+#include "tokenizer.h"
+
+struct ExprevalExpression {
+    Program* program;
+    uint64_t max_steps; // 0 for no limit
+};
+
+static void set_error(char* error, size_t error_size, const char* message) {
+    if (error == NULL || error_size == 0) return;
+    snprintf(error, error_size, "%s", message);
+}
+
+// Status of a failed compilation stage. Running out of the memory budget
+// looks like an ordinary allocation failure to the stage itself.
+static ExprevalStatus fail(const AllocationBudget* budget, bool out_of_memory, bool limit_exceeded,
+                           const char* message, char* error, size_t error_size) {
+    if (out_of_memory && budget->exceeded) {
+        set_error(error, error_size, "memory limit exceeded");
+        return EXPREVAL_LIMIT_EXCEEDED;
+    }
+    set_error(error, error_size, message);
+    if (out_of_memory) return EXPREVAL_OUT_OF_MEMORY;
+    return limit_exceeded ? EXPREVAL_LIMIT_EXCEEDED : EXPREVAL_SYNTAX_ERROR;
+}
+
+ExprevalStatus expreval_compile(const char* source, const ExprevalAllocator* allocator,
+                                ExprevalExpression** expression, char* error, size_t error_size) {
+    return expreval_compile_limited(source, allocator, NULL, expression, error, error_size);
+}
+
+ExprevalStatus expreval_compile_limited(const char* source, const ExprevalAllocator* allocator,
+                                        const ExprevalLimits* limits, ExprevalExpression** expression,
+                                        char* error, size_t error_size) {
+    *expression = NULL;
+    set_error(error, error_size, "");
+
+    ExprevalLimits no_limits = {0};
+    if (limits == NULL) limits = &no_limits;
+
+    Allocator chosen = allocator_or_default(NULL);
+    if (allocator != NULL) {
+        chosen = (Allocator){
+            .allocate = allocator->allocate,
+            .release = allocator->release,
+            .context = allocator->context};
+    }
+
+    // everything allocated from here on counts against max_memory
+    AllocationBudget budget = {
+        .inner = chosen,
+        .limit = limits->max_memory,
+        .used = 0,
+        .exceeded = false};
+    Allocator counted = budget_allocator(&budget);
+
+    Tokenizer* tokenizer = create_tokenizer(&counted);
+    if (tokenizer == NULL) {
+        return fail(&budget, true, false, "out of memory", error, error_size);
+    }
+    tokenizer->max_tokens = limits->max_tokens;
+
+    if (!tokenize_str(tokenizer, source)) {
+        ExprevalStatus status = fail(&budget, tokenizer->out_of_memory, tokenizer->limit_exceeded,
+                                     tokenizer->error, error, error_size);
+        free_tokenizer(tokenizer);
+        return status;
+    }
+
+    Parser* parser = create_parser(tokenizer);
+    if (parser == NULL) {
+        free_tokenizer(tokenizer);
+        return fail(&budget, true, false, "out of memory", error, error_size);
+    }
+    parser->max_nodes = limits->max_nodes;
+    parser->max_depth = limits->max_depth;
+
+    if (!parse(parser)) {
+        ExprevalStatus status = fail(&budget, parser->out_of_memory, parser->limit_exceeded,
+                                     parser->error, error, error_size);
+        free_parser(parser);
+        return status;
+    }
+
+    Program* program = compile(parser->root, &counted);
+    free_parser(parser);
+
+    ExprevalExpression* output = program == NULL ? NULL : allocate(&counted, sizeof(ExprevalExpression));
+    if (output == NULL) {
+        if (program != NULL) free_program(program);
+        return fail(&budget, true, false, "out of memory", error, error_size);
+    }
+
+    // the budget lives on this stack frame, evaluation allocates from the caller's allocator
+    program->allocator = chosen;
+
+    if (limits->max_steps != 0 && program->length > limits->max_steps) {
+        free_program(program);
+        release(&chosen, output);
+        return fail(&budget, false, true, "too many steps", error, error_size);
+    }
+
+    output->program = program;
+    output->max_steps = limits->max_steps;
+    *expression = output;
+    return EXPREVAL_OK;
+}
+
+uint32_t expreval_variable_count(const ExprevalExpression* expression) {
+    return expression->program->variable_count;
+}
+
+const char* expreval_variable_name(const ExprevalExpression* expression, uint32_t index) {
+    if (index >= expression->program->variable_count) return NULL;
+    return expression->program->variables[index];
+}
+
+float expreval_evaluate(const ExprevalExpression* expression, const float* variables) {
+    return run_program(expression->program, variables);
+}
+
+ExprevalStatus expreval_evaluate_batch(const ExprevalExpression* expression, const float* variables,
+                                       size_t count, float* results) {
+    const Program* program = expression->program;
+
+    // the whole call is checked up front, so evaluation itself never counts steps
+    if (expression->max_steps != 0 && count > expression->max_steps / program->length) {
+        return EXPREVAL_LIMIT_EXCEEDED;
+    }
+
+    // run_program_batch() counts rows in 32 bits
+    while (count > 0) {
+        uint32_t chunk = count > UINT32_MAX ? UINT32_MAX : (uint32_t)count;
+        if (!run_program_batch(program, variables, chunk, results)) return EXPREVAL_OUT_OF_MEMORY;
+
+        variables += (size_t)chunk * program->variable_count;
+        results += chunk;
+        count -= chunk;
+    }
+    return EXPREVAL_OK;
+}
+
+float expreval_gradient(const ExprevalExpression* expression, const float* variables, float* gradient) {
+    return evaluate_reverse(expression->program, variables, gradient);
+}
+
+void expreval_free(ExprevalExpression* expression) {
+    if (expression == NULL) return;
+
+    Allocator allocator = expression->program->allocator;
+    free_program(expression->program);
+    release(&allocator, expression);
+}
@@ -0,0 +1,91 @@
+#ifndef _EXPREVAL_H
+#define _EXPREVAL_H
+
+// Public interface of libexpreval. Everything else in source/ is internal.
+//
+// All functions are reentrant: they share no global state, and a compiled
+// expression may be evaluated from several threads at once. Evaluation takes
+// its scratch memory from the allocator the expression was compiled with, so
+// that allocator must be thread-safe for concurrent evaluation.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(EXPREVAL_BUILD) && defined(__GNUC__)
+#define EXPREVAL_API __attribute__((visibility("default")))
+#else
+#define EXPREVAL_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    EXPREVAL_OK,             // 0
+    EXPREVAL_SYNTAX_ERROR,   // 1
+    EXPREVAL_OUT_OF_MEMORY,  // 2
+    EXPREVAL_LIMIT_EXCEEDED, // 3, see ExprevalLimits
+} ExprevalStatus;
+
+// Every allocation of the library goes through these callbacks. Pass NULL
+// wherever an allocator is accepted to use malloc() and free().
+typedef struct {
+    void* (*allocate)(void* context, size_t size);
+    void (*release)(void* context, void* pointer);
+    void* context;
+} ExprevalAllocator;
+
+// Budgets for expressions from untrusted sources, a 0 leaves that budget
+// unlimited. All of them are checked before the work they bound is done, so
+// exceeding one fails early with EXPREVAL_LIMIT_EXCEEDED. Nesting deeper than
+// 1000 levels is always rejected this way, with or without limits, because
+// compilation recurses once per level.
+typedef struct {
+    uint32_t max_tokens;
+    uint32_t max_nodes; // of the syntax tree
+    uint32_t max_depth; // nesting of parentheses, calls, unary operators, powers and conditionals
+    size_t max_memory;  // bytes allocated by the compilation, the expression included
+    uint64_t max_steps; // instructions per evaluation call, every batch row counts separately
+} ExprevalLimits;
+
+typedef struct ExprevalExpression ExprevalExpression;
+
+// Compiles source into *expression. On failure *expression is NULL and, when
+// error isn't NULL, a description is written into it.
+EXPREVAL_API ExprevalStatus expreval_compile(const char* source, const ExprevalAllocator* allocator,
+                                             ExprevalExpression** expression, char* error, size_t error_size);
+
+// expreval_compile() within limits, which may be NULL for none. The step budget
+// is kept with the expression and applies to every evaluation of it.
+EXPREVAL_API ExprevalStatus expreval_compile_limited(const char* source, const ExprevalAllocator* allocator,
+                                                     const ExprevalLimits* limits, ExprevalExpression** expression,
+                                                     char* error, size_t error_size);
+
+// Variables are passed by position, in order of their first appearance in the source.
+EXPREVAL_API uint32_t expreval_variable_count(const ExprevalExpression* expression);
+EXPREVAL_API const char* expreval_variable_name(const ExprevalExpression* expression, uint32_t index);
+
+// expreval_evaluate(), expreval_evaluate_batch() and expreval_gradient() may
+// call the expression's allocator, from whichever thread calls them.
+
+// Returns NAN when out of memory.
+EXPREVAL_API float expreval_evaluate(const ExprevalExpression* expression, const float* variables);
+
+// variables holds count rows of expreval_variable_count() values each, one
+// result is written per row. Nothing is evaluated when the rows would exceed
+// the step budget.
+EXPREVAL_API ExprevalStatus expreval_evaluate_batch(const ExprevalExpression* expression, const float* variables,
+                                                    size_t count, float* results);
+
+// Evaluates like expreval_evaluate() and writes the partial derivative with
+// respect to every variable into gradient.
+EXPREVAL_API float expreval_gradient(const ExprevalExpression* expression, const float* variables, float* gradient);
+
+EXPREVAL_API void expreval_free(ExprevalExpression* expression);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _EXPREVAL_H
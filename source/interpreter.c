@@ -1,82 +1,194 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 
 #include "interpreter.h"
 #include "parser.h"
 
 
-static float interpret_node(Node* node) {
-    if(node == NULL) return 0.0;
-    
+static float interpret_node(Interpreter* interpreter, Node* node);
+
+static float variable_value(Interpreter* interpreter, char* name) {
+    for(uint32_t i = 0; i < interpreter->variable_count; ++i) {
+        if(strcmp(interpreter->variable_names[i], name) == 0) return interpreter->variable_values[i];
+    }
+    fprintf(stderr, "Unknown variable in interpret_node(): %s\n", name);
+    return NAN;
+}
+
+// Value of node once the value of its first child is known
+static float finish_node(Interpreter* interpreter, Node* node, float val_a) {
     switch (node->kind)
     {
     case NODE_KIND_ADD: {
-        Node* a = ((Node**)node->value)[0];
         Node* b = ((Node**)node->value)[1];
-        float val_a = interpret_node(a);
-        float val_b = interpret_node(b);
+        float val_b = interpret_node(interpreter, b);
         return val_a + val_b;
     }
     case NODE_KIND_SUBTRACT: {
-        Node* a = ((Node**)node->value)[0];
         Node* b = ((Node**)node->value)[1];
-        float val_a = interpret_node(a);
-        float val_b = interpret_node(b);
+        float val_b = interpret_node(interpreter, b);
         return val_a - val_b;
     }
     case NODE_KIND_MULTIPLY: {
-        Node* a = ((Node**)node->value)[0];
         Node* b = ((Node**)node->value)[1];
-        float val_a = interpret_node(a);
-        float val_b = interpret_node(b);
+        float val_b = interpret_node(interpreter, b);
         return val_a * val_b;
     }
     case NODE_KIND_DIVIDE: {
-        Node* a = ((Node**)node->value)[0];
         Node* b = ((Node**)node->value)[1];
-        float val_a = interpret_node(a);
-        float val_b = interpret_node(b);
+        float val_b = interpret_node(interpreter, b);
         return val_a / val_b;
     }
     case NODE_KIND_POW: {
-        Node* a = ((Node**)node->value)[0];
         Node* b = ((Node**)node->value)[1];
-        float val_a = interpret_node(a);
-        float val_b = interpret_node(b);
+        float val_b = interpret_node(interpreter, b);
         return pow(val_a, val_b);
     }
     case NODE_KIND_MINUS: {
-        Node* a = (Node*)node->value;
-        float val_a = interpret_node(a);
         return val_a * -1.0;
     }
-    case NODE_KIND_NUMBER: {
-        float num = *(float*)node->value;
-        return num;
+    case NODE_KIND_LESS: {
+        Node* b = ((Node**)node->value)[1];
+        float val_b = interpret_node(interpreter, b);
+        return val_a < val_b ? 1.0 : 0.0;
+    }
+    case NODE_KIND_LESS_EQUAL: {
+        Node* b = ((Node**)node->value)[1];
+        float val_b = interpret_node(interpreter, b);
+        return val_a <= val_b ? 1.0 : 0.0;
+    }
+    case NODE_KIND_GREATER: {
+        Node* b = ((Node**)node->value)[1];
+        float val_b = interpret_node(interpreter, b);
+        return val_a > val_b ? 1.0 : 0.0;
+    }
+    case NODE_KIND_GREATER_EQUAL: {
+        Node* b = ((Node**)node->value)[1];
+        float val_b = interpret_node(interpreter, b);
+        return val_a >= val_b ? 1.0 : 0.0;
+    }
+    case NODE_KIND_EQUAL: {
+        Node* b = ((Node**)node->value)[1];
+        float val_b = interpret_node(interpreter, b);
+        return val_a == val_b ? 1.0 : 0.0;
+    }
+    case NODE_KIND_NOT_EQUAL: {
+        Node* b = ((Node**)node->value)[1];
+        float val_b = interpret_node(interpreter, b);
+        return val_a != val_b ? 1.0 : 0.0;
+    }
+    case NODE_KIND_AND: {
+        Node* b = ((Node**)node->value)[1];
+        float val_b = interpret_node(interpreter, b);
+        return val_a != 0.0 && val_b != 0.0 ? 1.0 : 0.0;
+    }
+    case NODE_KIND_OR: {
+        Node* b = ((Node**)node->value)[1];
+        float val_b = interpret_node(interpreter, b);
+        return val_a != 0.0 || val_b != 0.0 ? 1.0 : 0.0;
+    }
+    case NODE_KIND_NOT: {
+        return val_a == 0.0 ? 1.0 : 0.0;
     }
-    
+    case NODE_KIND_CONDITIONAL: {
+        // only the taken branch is evaluated here, compiled programs evaluate both
+        Node* then = ((Node**)node->value)[1];
+        Node* otherwise = ((Node**)node->value)[2];
+        return interpret_node(interpreter, val_a != 0.0 ? then : otherwise);
+    }
+    case NODE_KIND_MIN: {
+        Node* b = ((Node**)node->value)[1];
+        float val_b = interpret_node(interpreter, b);
+        return val_a < val_b ? val_a : val_b;
+    }
+    case NODE_KIND_MAX: {
+        Node* b = ((Node**)node->value)[1];
+        float val_b = interpret_node(interpreter, b);
+        return val_a > val_b ? val_a : val_b;
+    }
+    case NODE_KIND_CLAMP: {
+        Node* low = ((Node**)node->value)[1];
+        Node* high = ((Node**)node->value)[2];
+        float val_low = interpret_node(interpreter, low);
+        float val_high = interpret_node(interpreter, high);
+        float raised = val_a < val_low ? val_low : val_a;
+        return raised > val_high ? val_high : raised;
+    }
+
     default:
-        fprintf(stderr, "Unhandled node in interpret_node()\n");
+        fprintf(stderr, "Unhandled node in finish_node()\n");
         exit(1);
     }
 
 }
 
+// Follows first children iteratively, see compile_node()
+static float interpret_node(Interpreter* interpreter, Node* node) {
+    if(node == NULL) return 0.0;
+
+    uint32_t bottom = interpreter->spine_length;
+    for(; node_child_count(node->kind) > 0; node = node_child(node, 0)) {
+        interpreter->spine[interpreter->spine_length++] = node;
+    }
+
+    float value = node->kind == NODE_KIND_NUMBER ? *(float*)node->value : variable_value(interpreter, (char*)node->value);
+
+    while(interpreter->spine_length > bottom) {
+        value = finish_node(interpreter, interpreter->spine[--interpreter->spine_length], value);
+    }
+    return value;
+}
+
 Interpreter* create_interpreter(Parser* parser) {
     Interpreter* interpreter = malloc(sizeof(Interpreter));
     *interpreter = (Interpreter){
-        .parser = parser
+        .parser = parser,
+        .variable_names = NULL,
+        .variable_values = NULL,
+        .variable_count = 0,
+        .spine = NULL,
+        .spine_length = 0
     };
     return interpreter;
 }
 
+void interpreter_set_variable(Interpreter* interpreter, char* name, float value) {
+    for(uint32_t i = 0; i < interpreter->variable_count; ++i) {
+        if(strcmp(interpreter->variable_names[i], name) == 0) {
+            interpreter->variable_values[i] = value;
+            return;
+        }
+    }
+
+    uint32_t count = interpreter->variable_count + 1;
+    interpreter->variable_names = realloc(interpreter->variable_names, sizeof(char*) * count);
+    interpreter->variable_values = realloc(interpreter->variable_values, sizeof(float) * count);
+
+    char* copy = malloc(strlen(name) + 1);
+    strcpy(copy, name);
+    interpreter->variable_names[count - 1] = copy;
+    interpreter->variable_values[count - 1] = value;
+    interpreter->variable_count = count;
+}
+
 float interpret(Interpreter* interpreter) {
     Parser* parser = interpreter->parser;
-    return interpret_node(parser->root);
+    // every node is on the spine at most once
+    interpreter->spine = malloc(sizeof(Node*) * (parser->node_count + 1));
+    float result = interpret_node(interpreter, parser->root);
+    free(interpreter->spine);
+    interpreter->spine = NULL;
+    return result;
 }
 
 void free_interpreter(Interpreter* interpreter) {
+    for(uint32_t i = 0; i < interpreter->variable_count; ++i) {
+        free(interpreter->variable_names[i]);
+    }
+    free(interpreter->variable_names);
+    free(interpreter->variable_values);
     free_parser(interpreter->parser);
     free(interpreter);
 }
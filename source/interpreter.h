@@ -1,14 +1,26 @@
 #ifndef _INTERPRETER_H
 #define _INTERPRETER_H
 
+#include <stdint.h>
+
 #include "parser.h"
 
 typedef struct {
     Parser* parser;
+
+    // values looked up by NODE_KIND_VARIABLE nodes
+    char** variable_names;
+    float* variable_values;
+    uint32_t variable_count;
+
+    // nodes waiting for the value of their first child during interpret()
+    Node** spine;
+    uint32_t spine_length;
 } Interpreter;
 
 Interpreter* create_interpreter(Parser* parser);
+void interpreter_set_variable(Interpreter* interpreter, char* name, float value);
 float interpret(Interpreter* interpreter);
 void free_interpreter(Interpreter* interpreter);
 
-#endif // _INTERPRETER_H
\ No newline at end of file
+#endif // _INTERPRETER_H
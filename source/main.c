@@ -1,13 +1,15 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include "tokenizer.h"
 #include "parser.h"
 #include "interpreter.h"
+#include "server.h"
 
 #define UI_SIZE 100
 
-float calculate(bool debug_info, char* str) {
+bool calculate(bool debug_info, char* str, float* result) {
     if(debug_info) {
         printf("----------------\n");
         printf("User input: \n");
@@ -15,8 +17,12 @@ float calculate(bool debug_info, char* str) {
         printf("%s\n\n", str);
     }
 
-    Tokenizer* tokenizer = create_tokenizer();
-    tokenize_str(tokenizer, str);
+    Tokenizer* tokenizer = create_tokenizer(NULL);
+    if(!tokenize_str(tokenizer, str)) {
+        fprintf(stderr, "%s\n", tokenizer->error);
+        free_tokenizer(tokenizer);
+        return false;
+    }
 
     if(debug_info) {
         printf("----------------\n");
@@ -27,7 +33,11 @@ float calculate(bool debug_info, char* str) {
     }
 
     Parser* parser = create_parser(tokenizer);
-    parse(parser);
+    if(!parse(parser)) {
+        fprintf(stderr, "%s\n", parser->error);
+        free_parser(parser);
+        return false;
+    }
 
     if(debug_info) {
         printf("----------------\n");
@@ -37,17 +47,17 @@ float calculate(bool debug_info, char* str) {
         printf("\n\n");
     }
     Interpreter* interpreter = create_interpreter(parser);
-    float result = interpret(interpreter);
+    *result = interpret(interpreter);
 
     if(debug_info) {
         printf("----------------\n");
         printf("Result: \n");
         printf("----------------\n");
-        printf("%f\n\n", result);
+        printf("%f\n\n", *result);
     }
     free_interpreter(interpreter);
 
-    return result;
+    return true;
 }
 
 void remove_newline(char* str) {
@@ -70,17 +80,25 @@ int main(int argc, char** argv) {
         printf("Printing debug\n");
     }
 
+    if(argc > 1 && strcmp(*argv, "-s") == 0) { // server: -s <socket path> [-w <workers>]
+        uint32_t workers = 0;
+        if(argc > 3 && strcmp(argv[2], "-w") == 0) workers = (uint32_t)atoi(argv[3]);
+        return run_server(argv[1], workers);
+    }
+
     printf("\"exit\" to quit\n");
 
     char user_input[UI_SIZE] = {0};
     while(true) {
         printf(" > ");
-        fgets(user_input, UI_SIZE, stdin);
+        if(fgets(user_input, UI_SIZE, stdin) == NULL) break; // end of input
         remove_newline(user_input);
 
         if(strcmp(user_input, "exit") == 0) break;
-        float result = calculate(debug, user_input);
-        printf("%f\n", result);
+        float result;
+        if(calculate(debug, user_input, &result)) {
+            printf("%f\n", result);
+        }
     }
 
     return 0;
@@ -3,38 +3,76 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "tokenizer.h"
 #include "word_table.h"
 
-static void free_parser_tree(Node* node) {
-    if (node == NULL) {
-        return;
-    }
-
-    switch (node->kind) {
-        case NODE_KIND_ADD:
-        case NODE_KIND_SUBTRACT:
-        case NODE_KIND_MULTIPLY:
-        case NODE_KIND_DIVIDE:
-        case NODE_KIND_POW:
-            free_parser_tree(((Node**)node->value)[0]);
-            free_parser_tree(((Node**)node->value)[1]);
-            break;
+uint32_t node_child_count(NodeKind kind) {
+    switch (kind) {
         case NODE_KIND_NUMBER:
-            free(node->value);
-            break;
+        case NODE_KIND_VARIABLE:
+            return 0;
         case NODE_KIND_MINUS:
-            free_parser_tree((Node*)node->value);
-            break;
+        case NODE_KIND_NOT:
+            return 1;
+        case NODE_KIND_CONDITIONAL:
+        case NODE_KIND_CLAMP:
+            return 3;
+        default:
+            return 2;
+    }
+}
+
+Node* node_child(Node* node, uint32_t index) {
+    return node_child_count(node->kind) == 1 ? (Node*)node->value : ((Node**)node->value)[index];
+}
+
+// Follows first children iteratively, see compile_node()
+static void free_parser_tree(Parser* parser, Node* node) {
+    while (node != NULL) {
+        uint32_t children = node_child_count(node->kind);
+        Node* first = children > 0 ? node_child(node, 0) : NULL;
+        for (uint32_t i = 1; i < children; ++i) {
+            free_parser_tree(parser, node_child(node, i));
+        }
+
+        if (children != 1) release(&parser->allocator, node->value);
+        release(&parser->allocator, node);
+        node = first;
+    }
+}
+
+static void free_parser_trees(Parser* parser, Node** nodes, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+        free_parser_tree(parser, nodes[i]);
     }
-    free(node);
 }
 
 void free_parser(Parser* parser) {
-    free_parser_tree(parser->root);
+    free_parser_tree(parser, parser->root);
     free_tokenizer(parser->tokenizer);
-    free(parser);
+    Allocator allocator = parser->allocator;
+    release(&allocator, parser);
+}
+
+static void print_infix(Node* node, char* operation) {
+    Node** values = (Node**)node->value;
+    printf("(");
+    print_tree(values[0]);
+    printf("%s", operation);
+    print_tree(values[1]);
+    printf(")");
+}
+
+static void print_call(Node* node, char* name) {
+    Node** values = (Node**)node->value;
+    printf("%s(", name);
+    for (uint32_t i = 0; i < node_child_count(node->kind); ++i) {
+        if (i > 0) printf(", ");
+        print_tree(values[i]);
+    }
+    printf(")");
 }
 
 void print_tree(Node* node) {
@@ -96,52 +134,244 @@ void print_tree(Node* node) {
             printf(")");
             break;
         }
+        case NODE_KIND_VARIABLE: {
+            printf("%s", (char*)node->value);
+            break;
+        }
+        case NODE_KIND_LESS:
+            print_infix(node, " < ");
+            break;
+        case NODE_KIND_LESS_EQUAL:
+            print_infix(node, " <= ");
+            break;
+        case NODE_KIND_GREATER:
+            print_infix(node, " > ");
+            break;
+        case NODE_KIND_GREATER_EQUAL:
+            print_infix(node, " >= ");
+            break;
+        case NODE_KIND_EQUAL:
+            print_infix(node, " == ");
+            break;
+        case NODE_KIND_NOT_EQUAL:
+            print_infix(node, " != ");
+            break;
+        case NODE_KIND_AND:
+            print_infix(node, " and ");
+            break;
+        case NODE_KIND_OR:
+            print_infix(node, " or ");
+            break;
+        case NODE_KIND_NOT: {
+            printf("(not ");
+            print_tree((Node*)node->value);
+            printf(")");
+            break;
+        }
+        case NODE_KIND_CONDITIONAL: {
+            Node** values = (Node**)node->value;
+            printf("(");
+            print_tree(values[0]);
+            printf(" ? ");
+            print_tree(values[1]);
+            printf(" : ");
+            print_tree(values[2]);
+            printf(")");
+            break;
+        }
+        case NODE_KIND_MIN:
+            print_call(node, "min");
+            break;
+        case NODE_KIND_MAX:
+            print_call(node, "max");
+            break;
+        case NODE_KIND_CLAMP:
+            print_call(node, "clamp");
+            break;
     }
 }
 
+// Records the first error and leaves the parser in a failed state. The caller
+// is expected to release any nodes it holds and return NULL.
 static void panic(Parser* parser, char* reason) {
+    if (parser->failed) return;
+
     Token* token = tokenizer_curr(parser->tokenizer);
     if (tokenizer_curr(parser->tokenizer) == NULL) {
         token = parser->tokenizer->last;
     }
-    fprintf(stderr, "Paniced in parsing at column %d: %s\n", token->column, reason);
-    free_parser(parser);
-    exit(1);
+    parser->failed = true;
+    snprintf(parser->error, sizeof(parser->error), "Paniced in parsing at column %d: %s", token->column, reason);
+}
+
+static void panic_out_of_memory(Parser* parser) {
+    if (!parser->failed) parser->out_of_memory = true;
+    panic(parser, "out of memory");
+}
+
+static void panic_limit(Parser* parser, char* reason) {
+    if (!parser->failed) parser->limit_exceeded = true;
+    panic(parser, reason);
+}
+
+// A NULL value means its allocation failed. On failure the parser fails and
+// the caller still owns value.
+static Node* make_node(Parser* parser, NodeKind kind, void* value) {
+    if (value != NULL && parser->max_nodes != 0 && parser->node_count >= parser->max_nodes) {
+        panic_limit(parser, "too many nodes");
+        return NULL;
+    }
+
+    Node* node = value == NULL ? NULL : allocate(&parser->allocator, sizeof(Node));
+    if (node == NULL) {
+        panic_out_of_memory(parser);
+        return NULL;
+    }
+
+    *node = (Node){
+        .kind = kind,
+        .value = value};
+    ++parser->node_count;
+    return node;
+}
+
+// Takes ownership of the children, they are released when out of memory.
+static Node* make_branch(Parser* parser, NodeKind kind, Node** children, uint32_t count) {
+    Node** value = allocate(&parser->allocator, sizeof(Node*) * count);
+    if (value == NULL) {
+        free_parser_trees(parser, children, count);
+        panic_out_of_memory(parser);
+        return NULL;
+    }
+    memcpy(value, children, sizeof(Node*) * count);
+
+    Node* result = make_node(parser, kind, value);
+    if (result == NULL) {
+        release(&parser->allocator, value);
+        free_parser_trees(parser, children, count);
+    }
+    return result;
+}
+
+static Node* make_binary(Parser* parser, NodeKind kind, Node* a, Node* b) {
+    Node* children[2] = {a, b};
+    return make_branch(parser, kind, children, 2);
+}
+
+static bool current_is(Parser* parser, TokenKind kind) {
+    Token* token = tokenizer_curr(parser->tokenizer);
+    return token != NULL && token->kind == kind;
+}
+
+static bool current_is_word(Parser* parser, char* word) {
+    Token* token = tokenizer_curr(parser->tokenizer);
+    return token != NULL && token->kind == TOKEN_KIND_WORD && strcmp((char*)token->value, word) == 0;
+}
+
+// Consumes the current token when it is of the given kind, fails the parser otherwise.
+static bool expect(Parser* parser, TokenKind kind) {
+    Token* token = tokenizer_curr(parser->tokenizer);
+    if (token == NULL || token->kind != kind) {
+        panic(parser, token == NULL ? "unexpected end" : "unexpected token");
+        return false;
+    }
+    tokenizer_next(parser->tokenizer);
+    return true;
 }
 
 static Node* get_expr(Parser* parser);
+
+// Parses rule one nesting level deeper, the recursive descent goes through
+// here wherever it can recurse without bound.
+static Node* get_nested(Parser* parser, Node* (*rule)(Parser*)) {
+    uint32_t max_depth = parser->max_depth != 0 && parser->max_depth < MAX_NESTING ? parser->max_depth : MAX_NESTING;
+    if (parser->depth >= max_depth) {
+        panic_limit(parser, "nested too deeply");
+        return NULL;
+    }
+
+    ++parser->depth;
+    Node* result = rule(parser);
+    --parser->depth;
+    return result;
+}
+
+// name '(' expr (',' expr)* ')', the name has already been consumed
+static Node* get_call(Parser* parser, char* name) {
+    const FunctionEntry* function = find_function(name);
+    if (function == NULL) {
+        panic(parser, "unknown function");
+        return NULL;
+    }
+    tokenizer_next(parser->tokenizer);  // consume '('
+
+    Node* arguments[3];
+    assert(function->arity <= 3);
+    for (uint32_t i = 0; i < function->arity; ++i) {
+        if (i > 0 && !expect(parser, TOKEN_KIND_COMMA)) {
+            free_parser_trees(parser, arguments, i);
+            return NULL;
+        }
+        arguments[i] = get_nested(parser, get_expr);
+        if (arguments[i] == NULL) {
+            free_parser_trees(parser, arguments, i);
+            return NULL;
+        }
+    }
+
+    if (!expect(parser, TOKEN_KIND_RPAREN)) {
+        free_parser_trees(parser, arguments, function->arity);
+        return NULL;
+    }
+    return make_branch(parser, function->kind, arguments, function->arity);
+}
+
 static Node* get_factor(Parser* parser) {
     Tokenizer* tokenizer = parser->tokenizer;
     Token* token = tokenizer_next(tokenizer);
 
     if (token == NULL) {
         panic(parser, "unexpected end");
+        return NULL;
     }
 
     if (token->kind == TOKEN_KIND_NUMBER) {
-        Node* output = malloc(sizeof(Node));
+        float* value = allocate(&parser->allocator, sizeof(float));
+        if (value != NULL) *value = *(float*)token->value;
 
-        float* value = malloc(sizeof(float));
-        *value = *(float*)token->value;
+        Node* output = make_node(parser, NODE_KIND_NUMBER, value);
+        if (output == NULL) release(&parser->allocator, value);
+        return output;
+    } else if (token->kind == TOKEN_KIND_WORD) {
+        if (word_is_keyword((char*)token->value)) {
+            panic(parser, "unexpected keyword");
+            return NULL;
+        }
+        if (current_is(parser, TOKEN_KIND_LPAREN)) {
+            return get_call(parser, (char*)token->value);
+        }
 
-        *output = (Node){
-            .kind = NODE_KIND_NUMBER,
-            .value = value};
+        char* name = allocate(&parser->allocator, strlen((char*)token->value) + 1);
+        if (name != NULL) strcpy(name, (char*)token->value);
 
+        Node* output = make_node(parser, NODE_KIND_VARIABLE, name);
+        if (output == NULL) release(&parser->allocator, name);
         return output;
     } else if (token->kind == TOKEN_KIND_LPAREN) {
-        Node* output = malloc(sizeof(Node));
-        output = get_expr(parser);
-        Token* node_rparen = tokenizer_curr(tokenizer);
-        if (node_rparen == NULL) panic(parser, "unexpected end");
-        if (node_rparen->kind != TOKEN_KIND_RPAREN) panic(parser, "unexpected token");
-        tokenizer_next(tokenizer);  // consume ')'
+        Node* output = get_nested(parser, get_expr);
+        if (output == NULL) return NULL;
+
+        if (!expect(parser, TOKEN_KIND_RPAREN)) {
+            free_parser_tree(parser, output);
+            return NULL;
+        }
         return output;
     } else if (token->kind == TOKEN_KIND_MINUS) {
-        Node* output = malloc(sizeof(Node));
-        *output = (Node){
-            .kind = NODE_KIND_MINUS,
-            .value = get_factor(parser)};
+        Node* operand = get_nested(parser, get_factor);
+        if (operand == NULL) return NULL;
+
+        Node* output = make_node(parser, NODE_KIND_MINUS, operand);
+        if (output == NULL) free_parser_tree(parser, operand);
         return output;
     }
 
@@ -153,19 +383,18 @@ static Node* get_power(Parser* parser) {
     Tokenizer* tokenizer = parser->tokenizer;
 
     Node* result = get_factor(parser);
+    if (result == NULL) return NULL;
 
     if (tokenizer_curr(tokenizer) != NULL &&
            (tokenizer_curr(tokenizer)->kind == TOKEN_KIND_CARET)) {
         tokenizer_next(tokenizer);  // consume ^
 
-        Node** value = malloc(sizeof(Node*) * 2);
-        value[0] = result;
-        value[1] = get_power(parser);
-
-        result = malloc(sizeof(Node));
-        *result = (Node){
-            .kind = NODE_KIND_POW,
-            .value = value};
+        Node* exponent = get_nested(parser, get_power);
+        if (exponent == NULL) {
+            free_parser_tree(parser, result);
+            return NULL;
+        }
+        result = make_binary(parser, NODE_KIND_POW, result, exponent);
     }
     return result;
 }
@@ -173,8 +402,8 @@ static Node* get_power(Parser* parser) {
 static Node* get_term(Parser* parser) {
     Tokenizer* tokenizer = parser->tokenizer;
 
-    // Node* result = get_factor(parser);
     Node* result = get_power(parser);
+    if (result == NULL) return NULL;
 
     while (tokenizer_curr(tokenizer) != NULL &&
            (tokenizer_curr(tokenizer)->kind == TOKEN_KIND_MULTIPLY || tokenizer_curr(tokenizer)->kind == TOKEN_KIND_DIVIDE)) {
@@ -182,60 +411,181 @@ static Node* get_term(Parser* parser) {
 
         NodeKind node_kind = token_kind == TOKEN_KIND_MULTIPLY ? NODE_KIND_MULTIPLY : NODE_KIND_DIVIDE;
 
-        // Node* node = malloc(sizeof(Node));
-        Node** value = malloc(sizeof(Node*) * 2);
-        value[0] = result;
-        value[1] = get_factor(parser);
-
-        result = malloc(sizeof(Node));
-        *result = (Node){
-            .kind = node_kind,
-            .value = value};
+        Node* rhs = get_power(parser);
+        if (rhs == NULL) {
+            free_parser_tree(parser, result);
+            return NULL;
+        }
+        result = make_binary(parser, node_kind, result, rhs);
     }
     return result;
 }
 
-static Node* get_expr(Parser* parser) {
+static Node* get_sum(Parser* parser) {
     Tokenizer* tokenizer = parser->tokenizer;
 
     Node* result = get_term(parser);
+    if (result == NULL) return NULL;
 
     while (tokenizer_curr(tokenizer) != NULL && (tokenizer_curr(tokenizer)->kind == TOKEN_KIND_PLUS || tokenizer_curr(tokenizer)->kind == TOKEN_KIND_MINUS)) {
         TokenKind token_kind = tokenizer_next(tokenizer)->kind;  // also consumes + or -
 
         NodeKind node_kind = token_kind == TOKEN_KIND_PLUS ? NODE_KIND_ADD : NODE_KIND_SUBTRACT;
 
-        // Node* node = malloc(sizeof(Node));
-        Node** value = malloc(sizeof(Node*) * 2);
-        value[0] = result;
-        value[1] = get_term(parser);
+        Node* rhs = get_term(parser);
+        if (rhs == NULL) {
+            free_parser_tree(parser, result);
+            return NULL;
+        }
+        result = make_binary(parser, node_kind, result, rhs);
+    }
+    return result;
+}
 
-        result = malloc(sizeof(Node));
-        *result = (Node){
-            .kind = node_kind,
-            .value = value};
+static NodeKind comparison_node_kind(TokenKind kind) {
+    switch (kind) {
+        case TOKEN_KIND_LESS: return NODE_KIND_LESS;
+        case TOKEN_KIND_LESS_EQUAL: return NODE_KIND_LESS_EQUAL;
+        case TOKEN_KIND_GREATER: return NODE_KIND_GREATER;
+        case TOKEN_KIND_GREATER_EQUAL: return NODE_KIND_GREATER_EQUAL;
+        case TOKEN_KIND_EQUAL: return NODE_KIND_EQUAL;
+        default: return NODE_KIND_NOT_EQUAL;
+    }
+}
+
+static bool current_is_comparison(Parser* parser) {
+    return current_is(parser, TOKEN_KIND_LESS) || current_is(parser, TOKEN_KIND_LESS_EQUAL) ||
+           current_is(parser, TOKEN_KIND_GREATER) || current_is(parser, TOKEN_KIND_GREATER_EQUAL) ||
+           current_is(parser, TOKEN_KIND_EQUAL) || current_is(parser, TOKEN_KIND_NOT_EQUAL);
+}
+
+static Node* get_comparison(Parser* parser) {
+    Tokenizer* tokenizer = parser->tokenizer;
+
+    Node* result = get_sum(parser);
+    if (result == NULL) return NULL;
+
+    while (current_is_comparison(parser)) {
+        NodeKind node_kind = comparison_node_kind(tokenizer_next(tokenizer)->kind);  // also consumes the comparison
+
+        Node* rhs = get_sum(parser);
+        if (rhs == NULL) {
+            free_parser_tree(parser, result);
+            return NULL;
+        }
+        result = make_binary(parser, node_kind, result, rhs);
+    }
+    return result;
+}
+
+static Node* get_not(Parser* parser) {
+    if (!current_is_word(parser, "not")) {
+        return get_comparison(parser);
+    }
+    tokenizer_next(parser->tokenizer);  // consume 'not'
+
+    Node* operand = get_nested(parser, get_not);
+    if (operand == NULL) return NULL;
+
+    Node* output = make_node(parser, NODE_KIND_NOT, operand);
+    if (output == NULL) free_parser_tree(parser, operand);
+    return output;
+}
+
+static Node* get_and(Parser* parser) {
+    Node* result = get_not(parser);
+    if (result == NULL) return NULL;
+
+    while (current_is_word(parser, "and")) {
+        tokenizer_next(parser->tokenizer);  // consume 'and'
+
+        Node* rhs = get_not(parser);
+        if (rhs == NULL) {
+            free_parser_tree(parser, result);
+            return NULL;
+        }
+        result = make_binary(parser, NODE_KIND_AND, result, rhs);
     }
     return result;
 }
 
-void parse(Parser* parser) {
+static Node* get_or(Parser* parser) {
+    Node* result = get_and(parser);
+    if (result == NULL) return NULL;
+
+    while (current_is_word(parser, "or")) {
+        tokenizer_next(parser->tokenizer);  // consume 'or'
+
+        Node* rhs = get_and(parser);
+        if (rhs == NULL) {
+            free_parser_tree(parser, result);
+            return NULL;
+        }
+        result = make_binary(parser, NODE_KIND_OR, result, rhs);
+    }
+    return result;
+}
+
+// condition ? a : b, right associative
+static Node* get_expr(Parser* parser) {
+    Node* condition = get_or(parser);
+    if (condition == NULL || !current_is(parser, TOKEN_KIND_QUESTION)) {
+        return condition;
+    }
+    tokenizer_next(parser->tokenizer);  // consume '?'
+
+    Node* children[3] = {condition, NULL, NULL};
+    children[1] = get_nested(parser, get_expr);
+    if (children[1] == NULL) {
+        free_parser_trees(parser, children, 1);
+        return NULL;
+    }
+    if (!expect(parser, TOKEN_KIND_COLON)) {
+        free_parser_trees(parser, children, 2);
+        return NULL;
+    }
+    children[2] = get_nested(parser, get_expr);
+    if (children[2] == NULL) {
+        free_parser_trees(parser, children, 2);
+        return NULL;
+    }
+    return make_branch(parser, NODE_KIND_CONDITIONAL, children, 3);
+}
+
+bool parse(Parser* parser) {
     Tokenizer* tokenizer = parser->tokenizer;
     if (tokenizer_curr(tokenizer) == NULL) {
-        return;
+        return true;
     }
 
-    parser->root = get_expr(parser);
+    Node* root = get_expr(parser);
+    if (root == NULL) return false;
 
     if (tokenizer_curr(tokenizer) != NULL) {
         panic(parser, "Invalid syntax");
+        free_parser_tree(parser, root);
+        return false;
     }
+
+    parser->root = root;
+    return true;
 }
 
 Parser* create_parser(Tokenizer* tokenizer) {
-    Parser* parser = malloc(sizeof(Parser));
+    Parser* parser = allocate(&tokenizer->allocator, sizeof(Parser));
+    if (parser == NULL) return NULL;
 
     *parser = (Parser){
+        .allocator = tokenizer->allocator,
         .root = NULL,
-        .tokenizer = tokenizer};
+        .tokenizer = tokenizer,
+        .max_nodes = 0,
+        .max_depth = 0,
+        .node_count = 0,
+        .depth = 0,
+        .failed = false,
+        .out_of_memory = false,
+        .limit_exceeded = false,
+        .error = {0}};
     return parser;
-}
\ No newline at end of file
+}
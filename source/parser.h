@@ -1,30 +1,74 @@
 #ifndef _PARSER_H
 #define _PARSER_H
 
+#include <stdbool.h>
+
+#include "allocator.h"
 #include "tokenizer.h"
 
+// Deepest nesting parse() accepts even without max_depth, the parser and
+// every walk over the tree recurse once per level
+#define MAX_NESTING 1000
+
 typedef enum {
-    NODE_KIND_NUMBER,   // 0
-    NODE_KIND_ADD,      // 1
-    NODE_KIND_SUBTRACT, // 2
-    NODE_KIND_MULTIPLY, // 3
-    NODE_KIND_DIVIDE,   // 4
-    NODE_KIND_POW,      // 5
-    NODE_KIND_MINUS,    // 6
+    NODE_KIND_NUMBER,        // 0
+    NODE_KIND_ADD,           // 1
+    NODE_KIND_SUBTRACT,      // 2
+    NODE_KIND_MULTIPLY,      // 3
+    NODE_KIND_DIVIDE,        // 4
+    NODE_KIND_POW,           // 5
+    NODE_KIND_MINUS,         // 6
+    NODE_KIND_VARIABLE,      // 7
+    NODE_KIND_LESS,          // 8
+    NODE_KIND_LESS_EQUAL,    // 9
+    NODE_KIND_GREATER,       // 10
+    NODE_KIND_GREATER_EQUAL, // 11
+    NODE_KIND_EQUAL,         // 12
+    NODE_KIND_NOT_EQUAL,     // 13
+    NODE_KIND_AND,           // 14
+    NODE_KIND_OR,            // 15
+    NODE_KIND_NOT,           // 16
+    NODE_KIND_CONDITIONAL,   // 17, condition ? a : b
+    NODE_KIND_MIN,           // 18
+    NODE_KIND_MAX,           // 19
+    NODE_KIND_CLAMP,         // 20, clamp(x, low, high)
 } NodeKind;
 
+// Comparisons and logic produce 1.0 for true and 0.0 for false, any value
+// other than 0.0 counts as true.
+//
+// value points to a Node*[node_child_count(kind)] for nodes with two or
+// three children, to the Node* itself for NODE_KIND_MINUS and NODE_KIND_NOT,
+// to a float for NODE_KIND_NUMBER and to the name for NODE_KIND_VARIABLE.
 typedef struct {
     NodeKind kind;
     void* value;
 } Node;
 
 typedef struct {
+    Allocator allocator; // taken over from the tokenizer
+
     Node* root;
     Tokenizer* tokenizer;
+
+    // parse() fails past these, 0 for no limit. The depth counts nested
+    // parentheses, calls, unary operators, powers and conditionals, and is
+    // never allowed past MAX_NESTING.
+    uint32_t max_nodes;
+    uint32_t max_depth;
+    uint32_t node_count;
+    uint32_t depth;
+
+    bool failed;         // set when parse() rejected the tokens
+    bool out_of_memory;  // the failure was an allocation, not the input
+    bool limit_exceeded; // the failure was max_nodes or max_depth, not the input
+    char error[150];     // description of the failure
 } Parser;
 
+uint32_t node_child_count(NodeKind kind);
+Node* node_child(Node* node, uint32_t index);
 Parser* create_parser(Tokenizer* tokenizer);
-void parse(Parser* parser);
+bool parse(Parser* parser);
 void free_parser(Parser* parser);
 void print_tree(Node* node);
 
@@ -0,0 +1,704 @@
+#define _GNU_SOURCE
+
+#include "server.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "expreval.h"
+
+#define MAX_EVENTS 64
+#define MAX_BATCH 1024      // requests evaluated together
+#define JOB_SIZE 256        // requests per worker job
+#define READ_SIZE 65536     // minimum free space for every read()
+#define INPUT_LIMIT (1 << 20)        // unparsed bytes per connection, more than the largest frame
+#define OUTPUT_HIGH_WATER (1 << 20)  // unsent bytes per connection before it stops being read
+#define CACHE_LIMIT 1024    // compiled expressions kept between batches
+#define CACHE_SLOTS 4096    // power of two, more than CACHE_LIMIT + MAX_BATCH
+
+// Budgets for every submitted expression. The node limit also bounds the work
+// per evaluated request, so there is no separate step budget.
+static const ExprevalLimits expression_limits = {
+    .max_tokens = 8192,
+    .max_nodes = 4096,
+    .max_depth = 256,
+    .max_memory = 1 << 20,
+    .max_steps = 0};
+
+// The bytes from start to length are pending, consumed ones before start are
+// only moved out of the way when the space is needed.
+typedef struct {
+    uint8_t* data;
+    size_t start;
+    size_t length;
+    size_t capacity;
+} Buffer;
+
+typedef struct Connection Connection;
+struct Connection {
+    int fd;
+    Buffer input;
+    Buffer output;
+    uint32_t events; // registered with epoll
+    bool eof;        // the client is done sending
+    bool closed;     // freed after the current batch
+    Connection* next;
+};
+
+typedef struct {
+    char* source; // NULL for an empty slot
+    uint32_t length;
+    uint64_t hash;
+    ExprevalExpression* expression;
+    ExprevalStatus status;
+} CacheEntry;
+
+typedef struct {
+    Connection* connection;
+    uint32_t id;
+    ExprevalExpression* expression;
+    uint32_t variable_offset; // into Batch.variables
+    ServerStatus status;
+    float result;
+} Request;
+
+typedef struct {
+    ExprevalExpression* expression;
+    const float* variables;
+    uint32_t count;
+    float* results;
+    ExprevalStatus status;
+} Job;
+
+typedef struct {
+    Request requests[MAX_BATCH];
+    uint32_t count;
+
+    // variables of all requests in arrival order, then regrouped per expression
+    float* variables;
+    float* grouped;
+    uint32_t variable_count;
+    uint32_t variable_capacity;
+
+    uint32_t order[MAX_BATCH]; // requests sorted by expression
+    float results[MAX_BATCH];  // in the order of order
+    Job jobs[MAX_BATCH];
+    uint32_t job_count;
+} Batch;
+
+typedef struct {
+    pthread_t* threads;
+    uint32_t thread_count;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+
+    Job* jobs;
+    uint32_t job_count;
+    uint32_t next_job;
+    uint32_t finished_jobs;
+    bool stopping;
+} WorkerPool;
+
+typedef struct {
+    int epoll_fd;
+    int listen_fd;
+    Connection* connections;
+    CacheEntry cache[CACHE_SLOTS];
+    uint32_t cache_count;
+    Batch batch;
+    WorkerPool pool;
+} Server;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop(int signal_number) {
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+///////////////// BUFFERS
+
+static size_t buffer_pending(const Buffer* buffer) {
+    return buffer->length - buffer->start;
+}
+
+static bool buffer_reserve(Buffer* buffer, size_t extra) {
+    if (buffer->length + extra <= buffer->capacity) return true;
+
+    // compacting moves at most as many bytes as were consumed, so it stays
+    // linear in the traffic
+    if (buffer->start > 0 && buffer->start >= buffer_pending(buffer)) {
+        memmove(buffer->data, buffer->data + buffer->start, buffer_pending(buffer));
+        buffer->length -= buffer->start;
+        buffer->start = 0;
+        if (buffer->length + extra <= buffer->capacity) return true;
+    }
+
+    size_t capacity = buffer->capacity == 0 ? READ_SIZE : buffer->capacity;
+    while (capacity < buffer->length + extra) capacity *= 2;
+
+    uint8_t* data = realloc(buffer->data, capacity);
+    if (data == NULL) return false;
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return true;
+}
+
+static void buffer_consume(Buffer* buffer, size_t amount) {
+    buffer->start += amount;
+    if (buffer->start == buffer->length) buffer->start = buffer->length = 0;
+}
+
+///////////////// WORKER POOL
+
+static void run_job(Job* job) {
+    job->status = expreval_evaluate_batch(job->expression, job->variables, job->count, job->results);
+}
+
+static void* worker_main(void* argument) {
+    WorkerPool* pool = argument;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (true) {
+        while (!pool->stopping && pool->next_job >= pool->job_count) {
+            pthread_cond_wait(&pool->work_ready, &pool->mutex);
+        }
+        if (pool->stopping) break;
+
+        Job* job = &pool->jobs[pool->next_job++];
+        pthread_mutex_unlock(&pool->mutex);
+        run_job(job);
+        pthread_mutex_lock(&pool->mutex);
+
+        if (++pool->finished_jobs == pool->job_count) {
+            pthread_cond_signal(&pool->work_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+static bool start_pool(WorkerPool* pool, uint32_t thread_count) {
+    *pool = (WorkerPool){
+        .threads = malloc(sizeof(pthread_t) * thread_count),
+        .thread_count = 0,
+        .jobs = NULL,
+        .job_count = 0,
+        .next_job = 0,
+        .finished_jobs = 0,
+        .stopping = false};
+    if (pool->threads == NULL) return false;
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    for (uint32_t i = 0; i < thread_count; ++i) {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) return false;
+        ++pool->thread_count;
+    }
+    return true;
+}
+
+static void stop_pool(WorkerPool* pool) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (uint32_t i = 0; i < pool->thread_count; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    free(pool->threads);
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_cond_destroy(&pool->work_done);
+}
+
+// Hands the jobs to the workers and waits until all of them are done.
+static void run_jobs(WorkerPool* pool, Job* jobs, uint32_t job_count) {
+    if (job_count == 0) return;
+    if (job_count == 1 || pool->thread_count == 0) {
+        for (uint32_t i = 0; i < job_count; ++i) run_job(&jobs[i]);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->jobs = jobs;
+    pool->job_count = job_count;
+    pool->next_job = 0;
+    pool->finished_jobs = 0;
+    pthread_cond_broadcast(&pool->work_ready);
+    while (pool->finished_jobs < pool->job_count) {
+        pthread_cond_wait(&pool->work_done, &pool->mutex);
+    }
+    pool->jobs = NULL;
+    pool->job_count = 0;
+    pool->next_job = 0;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+///////////////// EXPRESSION CACHE
+
+static uint64_t hash_source(const uint8_t* source, uint32_t length) {
+    uint64_t hash = 14695981039346656037ULL;  // FNV-1a
+    for (uint32_t i = 0; i < length; ++i) {
+        hash ^= source[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void clear_cache(Server* server) {
+    for (uint32_t i = 0; i < CACHE_SLOTS; ++i) {
+        CacheEntry* entry = &server->cache[i];
+        if (entry->source == NULL) continue;
+        free(entry->source);
+        expreval_free(entry->expression);
+        *entry = (CacheEntry){.source = NULL};
+    }
+    server->cache_count = 0;
+}
+
+static ServerStatus server_status(ExprevalStatus status) {
+    switch (status) {
+        case EXPREVAL_OK: return SERVER_STATUS_OK;
+        case EXPREVAL_SYNTAX_ERROR: return SERVER_STATUS_SYNTAX_ERROR;
+        case EXPREVAL_OUT_OF_MEMORY: return SERVER_STATUS_OUT_OF_MEMORY;
+        case EXPREVAL_LIMIT_EXCEEDED: return SERVER_STATUS_LIMIT_EXCEEDED;
+    }
+    return SERVER_STATUS_OUT_OF_MEMORY;
+}
+
+// Compiles every distinct source once. Failed compilations are cached too, so
+// a client repeating a broken formula doesn't cost a compile per request.
+static CacheEntry* lookup_expression(Server* server, const uint8_t* source, uint32_t length) {
+    uint64_t hash = hash_source(source, length);
+    uint32_t slot = hash & (CACHE_SLOTS - 1);
+
+    while (server->cache[slot].source != NULL) {
+        CacheEntry* entry = &server->cache[slot];
+        if (entry->hash == hash && entry->length == length && memcmp(entry->source, source, length) == 0) {
+            return entry;
+        }
+        slot = (slot + 1) & (CACHE_SLOTS - 1);
+    }
+
+    char* copy = malloc(length + 1);
+    if (copy == NULL) return NULL;
+    memcpy(copy, source, length);
+    copy[length] = '\0';
+
+    CacheEntry* entry = &server->cache[slot];
+    *entry = (CacheEntry){
+        .source = copy,
+        .length = length,
+        .hash = hash,
+        .expression = NULL};
+    entry->status = expreval_compile_limited(copy, NULL, &expression_limits, &entry->expression, NULL, 0);
+    ++server->cache_count;
+    return entry;
+}
+
+///////////////// CONNECTIONS
+
+static bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static void accept_connections(Server* server) {
+    while (true) {
+        int fd = accept(server->listen_fd, NULL, NULL);
+        if (fd < 0) return;  // EAGAIN once the backlog is empty
+
+        Connection* connection = calloc(1, sizeof(Connection));
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = connection};
+        if (connection != NULL) connection->events = EPOLLIN;
+        if (connection == NULL || !set_nonblocking(fd) || epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            free(connection);
+            close(fd);
+            continue;
+        }
+
+        connection->fd = fd;
+        connection->next = server->connections;
+        server->connections = connection;
+    }
+}
+
+// Reads until the socket is drained or INPUT_LIMIT bytes are waiting, the rest
+// stays in the socket until a batch has consumed them.
+static void read_connection(Connection* connection) {
+    while (buffer_pending(&connection->input) < INPUT_LIMIT) {
+        if (!buffer_reserve(&connection->input, READ_SIZE)) {
+            connection->closed = true;
+            return;
+        }
+
+        Buffer* input = &connection->input;
+        ssize_t amount = read(connection->fd, input->data + input->length, input->capacity - input->length);
+        if (amount > 0) {
+            input->length += amount;
+        } else if (amount < 0 && errno == EINTR) {
+            continue;
+        } else if (amount == 0) {
+            connection->eof = true;
+            return;
+        } else {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) connection->closed = true;
+            return;
+        }
+    }
+}
+
+// Whether the connection can take more input. After eof a level-triggered
+// EPOLLIN would fire forever, and a client that sends without reading the
+// answers is left alone until they drain below OUTPUT_HIGH_WATER.
+static bool wants_input(const Connection* connection) {
+    return !connection->eof && buffer_pending(&connection->input) < INPUT_LIMIT &&
+           buffer_pending(&connection->output) < OUTPUT_HIGH_WATER;
+}
+
+static void update_events(Server* server, Connection* connection) {
+    uint32_t events = (wants_input(connection) ? EPOLLIN : 0) | (buffer_pending(&connection->output) > 0 ? EPOLLOUT : 0);
+    if (connection->events == events) return;
+
+    struct epoll_event event = {
+        .events = events,
+        .data.ptr = connection};
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+    connection->events = events;
+}
+
+static void flush_connection(Connection* connection) {
+    Buffer* output = &connection->output;
+    size_t written = 0;
+
+    while (written < buffer_pending(output)) {
+        ssize_t amount = send(connection->fd, output->data + output->start + written, buffer_pending(output) - written,
+                              MSG_NOSIGNAL);
+        if (amount > 0) {
+            written += amount;
+        } else if (amount < 0 && errno == EINTR) {
+            continue;
+        } else {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) connection->closed = true;
+            break;
+        }
+    }
+
+    buffer_consume(output, written);
+}
+
+// Frees closed connections and those that sent eof and got all their answers,
+// updates the epoll registration of the others.
+static void update_connections(Server* server) {
+    Connection** link = &server->connections;
+    while (*link != NULL) {
+        Connection* connection = *link;
+        if (connection->eof && buffer_pending(&connection->output) == 0) connection->closed = true;
+        if (!connection->closed) {
+            update_events(server, connection);
+            link = &connection->next;
+            continue;
+        }
+
+        *link = connection->next;
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+        close(connection->fd);
+        free(connection->input.data);
+        free(connection->output.data);
+        free(connection);
+    }
+}
+
+///////////////// BATCHES
+
+static bool reserve_variables(Batch* batch, uint32_t extra) {
+    if (batch->variable_count + extra <= batch->variable_capacity) return true;
+
+    uint32_t capacity = batch->variable_capacity == 0 ? 4096 : batch->variable_capacity;
+    while (capacity < batch->variable_count + extra) capacity *= 2;
+
+    float* variables = realloc(batch->variables, sizeof(float) * capacity);
+    if (variables == NULL) return false;
+    batch->variables = variables;
+
+    float* grouped = realloc(batch->grouped, sizeof(float) * capacity);
+    if (grouped == NULL) return false;
+    batch->grouped = grouped;
+
+    batch->variable_capacity = capacity;
+    return true;
+}
+
+// Moves complete frames from the input buffers of all connections into the
+// batch. Returns false when there was nothing to take.
+static bool collect_requests(Server* server) {
+    Batch* batch = &server->batch;
+    batch->count = 0;
+    batch->variable_count = 0;
+
+    // entries are only freed between batches, requests keep pointing at them
+    if (server->cache_count >= CACHE_LIMIT) clear_cache(server);
+
+    for (Connection* connection = server->connections; connection != NULL; connection = connection->next) {
+        // the rest waits until the client reads its answers
+        if (connection->closed || buffer_pending(&connection->output) >= OUTPUT_HIGH_WATER) continue;
+
+        Buffer* input = &connection->input;
+        size_t offset = input->start;
+        while (batch->count < MAX_BATCH && input->length - offset >= SERVER_REQUEST_HEADER_SIZE) {
+            uint8_t* frame = input->data + offset;
+            uint32_t id;
+            uint16_t source_length;
+            uint16_t variable_count;
+            memcpy(&id, frame, sizeof(id));
+            memcpy(&source_length, frame + 4, sizeof(source_length));
+            memcpy(&variable_count, frame + 6, sizeof(variable_count));
+
+            size_t frame_size = SERVER_REQUEST_HEADER_SIZE + source_length + sizeof(float) * variable_count;
+            if (input->length - offset < frame_size) break;
+            if (!reserve_variables(batch, variable_count)) break;
+
+            Request* request = &batch->requests[batch->count++];
+            *request = (Request){
+                .connection = connection,
+                .id = id,
+                .expression = NULL,
+                .variable_offset = batch->variable_count,
+                .status = SERVER_STATUS_OK,
+                .result = 0.0};
+
+            CacheEntry* entry = lookup_expression(server, frame + SERVER_REQUEST_HEADER_SIZE, source_length);
+            if (entry == NULL) {
+                request->status = SERVER_STATUS_OUT_OF_MEMORY;
+            } else if (entry->status != EXPREVAL_OK) {
+                request->status = server_status(entry->status);
+            } else if (expreval_variable_count(entry->expression) != variable_count) {
+                request->status = SERVER_STATUS_WRONG_VARIABLES;
+            } else {
+                request->expression = entry->expression;
+            }
+
+            memcpy(&batch->variables[batch->variable_count], frame + SERVER_REQUEST_HEADER_SIZE + source_length,
+                   sizeof(float) * variable_count);
+            batch->variable_count += variable_count;
+            offset += frame_size;
+        }
+        buffer_consume(input, offset - input->start);
+    }
+
+    return batch->count > 0;
+}
+
+static int compare_requests(const void* a, const void* b, void* argument) {
+    Request* requests = argument;
+    uintptr_t expression_a = (uintptr_t)requests[*(const uint32_t*)a].expression;
+    uintptr_t expression_b = (uintptr_t)requests[*(const uint32_t*)b].expression;
+    if (expression_a != expression_b) return expression_a < expression_b ? -1 : 1;
+    // keep arrival order inside a group
+    return *(const uint32_t*)a < *(const uint32_t*)b ? -1 : 1;
+}
+
+// Groups the requests by expression, so each group runs through
+// expreval_evaluate_batch() with its variables laid out contiguously.
+static void evaluate_batch(Server* server) {
+    Batch* batch = &server->batch;
+
+    for (uint32_t i = 0; i < batch->count; ++i) batch->order[i] = i;
+    qsort_r(batch->order, batch->count, sizeof(uint32_t), compare_requests, batch->requests);
+
+    batch->job_count = 0;
+    uint32_t grouped_offset = 0;
+    for (uint32_t start = 0; start < batch->count;) {
+        ExprevalExpression* expression = batch->requests[batch->order[start]].expression;
+        uint32_t end = start + 1;
+        while (end < batch->count && end - start < JOB_SIZE &&
+               batch->requests[batch->order[end]].expression == expression) {
+            ++end;
+        }
+
+        if (expression != NULL) {
+            uint32_t variable_count = expreval_variable_count(expression);
+            Job* job = &batch->jobs[batch->job_count++];
+            *job = (Job){
+                .expression = expression,
+                .variables = &batch->grouped[grouped_offset],
+                .count = end - start,
+                .results = &batch->results[start],
+                .status = EXPREVAL_OK};
+
+            for (uint32_t i = start; i < end; ++i) {
+                Request* request = &batch->requests[batch->order[i]];
+                memcpy(&batch->grouped[grouped_offset], &batch->variables[request->variable_offset],
+                       sizeof(float) * variable_count);
+                grouped_offset += variable_count;
+            }
+        }
+        start = end;
+    }
+
+    run_jobs(&server->pool, batch->jobs, batch->job_count);
+
+    for (uint32_t j = 0; j < batch->job_count; ++j) {
+        Job* job = &batch->jobs[j];
+        uint32_t start = job->results - batch->results;
+        for (uint32_t i = start; i < start + job->count; ++i) {
+            Request* request = &batch->requests[batch->order[i]];
+            request->result = batch->results[i];
+            if (job->status != EXPREVAL_OK) request->status = server_status(job->status);
+        }
+    }
+}
+
+static void write_responses(Server* server) {
+    Batch* batch = &server->batch;
+
+    for (uint32_t i = 0; i < batch->count; ++i) {
+        Request* request = &batch->requests[i];
+        Connection* connection = request->connection;
+        if (connection->closed || !buffer_reserve(&connection->output, SERVER_RESPONSE_SIZE)) {
+            connection->closed = true;
+            continue;
+        }
+
+        uint8_t* response = connection->output.data + connection->output.length;
+        uint8_t status = request->status;
+        memcpy(response, &request->id, sizeof(request->id));
+        memcpy(response + 4, &status, sizeof(status));
+        memcpy(response + 5, &request->result, sizeof(request->result));
+        connection->output.length += SERVER_RESPONSE_SIZE;
+    }
+
+    for (Connection* connection = server->connections; connection != NULL; connection = connection->next) {
+        if (!connection->closed && buffer_pending(&connection->output) > 0) flush_connection(connection);
+    }
+}
+
+static void process_requests(Server* server) {
+    while (collect_requests(server)) {
+        evaluate_batch(server);
+        write_responses(server);
+    }
+}
+
+///////////////// SETUP
+
+static int open_socket(const char* socket_path) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    unlink(socket_path);  // left behind by a previous run
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0 || !set_nonblocking(fd)) {
+        perror(socket_path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int run_server(const char* socket_path, uint32_t worker_count) {
+    if (worker_count == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        worker_count = cpus > 0 ? (uint32_t)cpus : 1;
+    }
+
+    Server* server = calloc(1, sizeof(Server));
+    if (server == NULL) return 1;
+
+    server->listen_fd = open_socket(socket_path);
+    server->epoll_fd = epoll_create1(0);
+    struct epoll_event listen_event = {.events = EPOLLIN, .data.ptr = NULL};
+    if (server->listen_fd < 0 || server->epoll_fd < 0 ||
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &listen_event) != 0 ||
+        !start_pool(&server->pool, worker_count)) {
+        fprintf(stderr, "Could not start server on %s\n", socket_path);
+        return 1;
+    }
+
+    struct sigaction action = {.sa_handler = handle_stop};
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    printf("Serving on %s with %u workers\n", socket_path, worker_count);
+    fflush(stdout);
+
+    struct epoll_event events[MAX_EVENTS];
+    while (!stop_requested) {
+        int count = epoll_wait(server->epoll_fd, events, MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            Connection* connection = events[i].data.ptr;
+            if (connection == NULL) {
+                accept_connections(server);
+                continue;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) connection->closed = true;
+            if (events[i].events & EPOLLIN) read_connection(connection);
+            if ((events[i].events & EPOLLOUT) && !connection->closed) flush_connection(connection);
+        }
+
+        // everything read during this wakeup is evaluated together
+        process_requests(server);
+        update_connections(server);
+    }
+
+    for (Connection* connection = server->connections; connection != NULL; connection = connection->next) {
+        connection->closed = true;
+    }
+    update_connections(server);
+    stop_pool(&server->pool);
+    clear_cache(server);
+    free(server->batch.variables);
+    free(server->batch.grouped);
+    close(server->epoll_fd);
+    close(server->listen_fd);
+    unlink(socket_path);
+    free(server);
+    return 0;
+}
+
+#else
+
+#include <stdio.h>
+
+int run_server(const char* socket_path, uint32_t worker_count) {
+    (void)socket_path;
+    (void)worker_count;
+    fprintf(stderr, "Server mode needs epoll and is only available on Linux\n");
+    return 1;
+}
+
+#endif // __linux__
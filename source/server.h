@@ -0,0 +1,30 @@
+#ifndef _SERVER_H
+#define _SERVER_H
+
+#include <stdint.h>
+
+// Wire format, all fields in host byte order since the socket is local:
+//
+// request:  uint32 id, uint16 source length, uint16 variable count,
+//           source bytes, float variables[variable count]
+// response: uint32 id, uint8 status, float result (unpadded)
+//
+// Variables are passed by position, as with expreval_evaluate(). Responses on
+// a connection come back in the order of its requests.
+
+#define SERVER_REQUEST_HEADER_SIZE 8
+#define SERVER_RESPONSE_SIZE 9
+
+typedef enum {
+    SERVER_STATUS_OK,              // 0
+    SERVER_STATUS_SYNTAX_ERROR,    // 1
+    SERVER_STATUS_OUT_OF_MEMORY,   // 2
+    SERVER_STATUS_WRONG_VARIABLES, // 3, variable count doesn't match the expression
+    SERVER_STATUS_LIMIT_EXCEEDED,  // 4, the expression is too large or too deeply nested
+} ServerStatus;
+
+// Serves on a Unix-domain socket until SIGINT or SIGTERM. A worker_count of 0
+// uses one worker per online CPU. Returns the process exit code.
+int run_server(const char* socket_path, uint32_t worker_count);
+
+#endif // _SERVER_H
@@ -7,36 +7,60 @@
 #include <stdlib.h>
 #include <string.h>
 
+// Records the first error, tokenize_str() stops at the next character.
 static void panic(Tokenizer* tokenizer, char* reason) {
-    fprintf(stderr, "Paniced in tokenization at column %d: %s\n", tokenizer->_curr_col, reason);
-    free_tokenizer(tokenizer);
-    exit(1);
+    if (tokenizer->failed) return;
+
+    tokenizer->failed = true;
+    snprintf(tokenizer->error, sizeof(tokenizer->error), "Paniced in tokenization at column %d: %s", tokenizer->_curr_col, reason);
+}
+
+static void panic_out_of_memory(Tokenizer* tokenizer) {
+    if (!tokenizer->failed) tokenizer->out_of_memory = true;
+    panic(tokenizer, "out of memory");
+}
+
+static void panic_limit(Tokenizer* tokenizer, char* reason) {
+    if (!tokenizer->failed) tokenizer->limit_exceeded = true;
+    panic(tokenizer, reason);
 }
 
-static void free_token(Token* token) {
-    free(token->value);
-    free(token);
+static void free_token(Tokenizer* tokenizer, Token* token) {
+    release(&tokenizer->allocator, token->value);
+    release(&tokenizer->allocator, token);
 }
 
-static void free_tokens(Token* token) {
-    if (token == NULL) return;
-    free_tokens(token->next);
-    free_token(token);
+static void free_tokens(Tokenizer* tokenizer, Token* token) {
+    while (token != NULL) {
+        Token* next = token->next;
+        free_token(tokenizer, token);
+        token = next;
+    }
 }
 
 void free_tokenizer(Tokenizer* tokenizer) {
-    free_tokens(tokenizer->head);
-    free(tokenizer);
+    free_tokens(tokenizer, tokenizer->head);
+    Allocator allocator = tokenizer->allocator;
+    release(&allocator, tokenizer);
 }
 
-Tokenizer* create_tokenizer() {
-    Tokenizer* tokenizer = malloc(sizeof(Tokenizer));
+Tokenizer* create_tokenizer(const Allocator* allocator) {
+    Allocator chosen = allocator_or_default(allocator);
+    Tokenizer* tokenizer = allocate(&chosen, sizeof(Tokenizer));
+    if (tokenizer == NULL) return NULL;
 
     *tokenizer = (Tokenizer){
+        .allocator = chosen,
         .head = NULL,
         .last = NULL,
         .current = NULL,
-        ._curr_col = 0};
+        ._curr_col = 0,
+        .max_tokens = 0,
+        .token_count = 0,
+        .failed = false,
+        .out_of_memory = false,
+        .limit_exceeded = false,
+        .error = {0}};
 
     return tokenizer;
 }
@@ -67,13 +91,41 @@ static void append_token(Tokenizer* tokenizer, Token* token) {
     tokenizer->last = token;
 }
 
+// Takes ownership of value, which is released again when out of memory.
+static void push_token(Tokenizer* tokenizer, TokenKind kind, void* value) {
+    if (tokenizer->max_tokens != 0 && tokenizer->token_count >= tokenizer->max_tokens) {
+        release(&tokenizer->allocator, value);
+        panic_limit(tokenizer, "too many tokens");
+        return;
+    }
+
+    Token* token = allocate(&tokenizer->allocator, sizeof(Token));
+    if (token == NULL) {
+        release(&tokenizer->allocator, value);
+        panic_out_of_memory(tokenizer);
+        return;
+    }
+
+    *token = (Token){
+        .kind = kind,
+        .value = value,
+        .next = NULL,
+        .column = tokenizer->_curr_col};
+    append_token(tokenizer, token);
+    ++tokenizer->token_count;
+}
+
 static bool is_digit(char c);  // construct_number_token() depends on is_digit()
-static uint32_t construct_number_token(Tokenizer* tokenizer, char* str, uint32_t index) {
+static uint32_t construct_number_token(Tokenizer* tokenizer, const char* str, uint32_t index) {
     char accu[50];
-    uint8_t accu_index = 0;
+    uint32_t accu_index = 0;
 
-    uint8_t dot_amt = 0;
+    uint32_t dot_amt = 0;
     while (is_digit(str[index])) {
+        if (accu_index + 1 >= sizeof(accu)) {
+            panic(tokenizer, "number too long");
+            return accu_index;
+        }
         if (str[index] == '.') ++dot_amt;
         accu[accu_index++] = str[index++];
     }
@@ -82,35 +134,32 @@ static uint32_t construct_number_token(Tokenizer* tokenizer, char* str, uint32_t
         char buffer[100];
         snprintf(buffer, 100, "Unknown character for constructing number token: %c", str[index]);
         panic(tokenizer, buffer);
+        return accu_index;
     }
 
     accu[accu_index] = '\0';
-    float* num = malloc(sizeof(float));
+    float* num = allocate(&tokenizer->allocator, sizeof(float));
+    if (num == NULL) {
+        panic_out_of_memory(tokenizer);
+        return accu_index;
+    }
     *num = atof(accu);
 
-    Token* token = malloc(sizeof(Token));
-    *token = (Token){
-        .kind = TOKEN_KIND_NUMBER,
-        .value = num,
-        .next = NULL,
-        .column = tokenizer->_curr_col};
-    append_token(tokenizer, token);
+    push_token(tokenizer, TOKEN_KIND_NUMBER, num);
 
     return accu_index;
 }
 
 static uint32_t construct_word_token(Tokenizer* tokenizer, char* str) {
     size_t len = strlen(str);
-    char* word = malloc(sizeof(char) * (len + 1));
+    char* word = allocate(&tokenizer->allocator, sizeof(char) * (len + 1));
+    if (word == NULL) {
+        panic_out_of_memory(tokenizer);
+        return len;
+    }
     strcpy(word, str);
 
-    Token* token = malloc(sizeof(Token));
-    *token = (Token){
-        .kind = TOKEN_KIND_WORD,
-        .value = word,
-        .next = NULL,
-        .column = tokenizer->_curr_col};
-    append_token(tokenizer, token);
+    push_token(tokenizer, TOKEN_KIND_WORD, word);
 
     return len;
 }
@@ -137,26 +186,48 @@ static void construct_op_token(Tokenizer* tokenizer, char c) {
             char buffer[50];
             snprintf(buffer, 50, "invalid operation character: %c", c);
             panic(tokenizer, buffer);
+            return;
         }
     }
 
-    Token* token = malloc(sizeof(Token));
-    *token = (Token){
-        .kind = kind,
-        .value = NULL,
-        .next = NULL,
-        .column = tokenizer->_curr_col};
-    append_token(tokenizer, token);
+    push_token(tokenizer, kind, NULL);
 }
 
 static void construct_single_char_token(Tokenizer* tokenizer, TokenKind kind) {
-    Token* token = malloc(sizeof(Token));
-    *token = (Token){
-        .kind = kind,
-        .value = NULL,
-        .next = NULL,
-        .column = tokenizer->_curr_col};
-    append_token(tokenizer, token);
+    push_token(tokenizer, kind, NULL);
+}
+
+// Comparisons are one or two characters long, returns how many were used.
+static uint32_t construct_comparison_token(Tokenizer* tokenizer, const char* str, uint32_t index) {
+    bool followed_by_equals = str[index + 1] == '=';
+    TokenKind kind;
+    switch (str[index]) {
+        case '<':
+            kind = followed_by_equals ? TOKEN_KIND_LESS_EQUAL : TOKEN_KIND_LESS;
+            break;
+        case '>':
+            kind = followed_by_equals ? TOKEN_KIND_GREATER_EQUAL : TOKEN_KIND_GREATER;
+            break;
+        case '=':
+        case '!':
+            if (!followed_by_equals) {
+                char buffer[50];
+                snprintf(buffer, 50, "expected '=' after '%c'", str[index]);
+                panic(tokenizer, buffer);
+                return 1;
+            }
+            kind = str[index] == '=' ? TOKEN_KIND_EQUAL : TOKEN_KIND_NOT_EQUAL;
+            break;
+        default: {
+            char buffer[50];
+            snprintf(buffer, 50, "invalid comparison character: %c", str[index]);
+            panic(tokenizer, buffer);
+            return 1;
+        }
+    }
+
+    push_token(tokenizer, kind, NULL);
+    return followed_by_equals ? 2 : 1;
 }
 
 ///////////////// SIMPLE HELPER FUNCTIONS
@@ -181,6 +252,18 @@ static bool is_special_op(char c) {
     }
 }
 
+static bool is_comparison(char c) {
+    switch (c) {
+        case '<':
+        case '>':
+        case '=':
+        case '!':
+            return true;
+        default:
+            return false;
+    }
+}
+
 static bool is_digit(char c) {
     return (c >= '0' && c <= '9') || c == '.';
 }
@@ -194,18 +277,17 @@ static bool should_ignore(char c) {
     return false;
 }
 
-static void get_word_str(Tokenizer* tokenizer, char* buffer, uint32_t buffer_size, char* str, uint32_t index) {
+static bool get_word_str(Tokenizer* tokenizer, char* buffer, uint32_t buffer_size, const char* str, uint32_t index) {
     uint32_t buffer_index = 0;
     while (is_word_char(str[index])) {
         if (buffer_index + 1 >= buffer_size) {
             panic(tokenizer, "word too long");
+            return false;
         }
         buffer[buffer_index++] = str[index++];
     }
-    if (buffer_index >= buffer_size) {
-        panic(tokenizer, "word too long");
-    }
     buffer[buffer_index] = '\0';
+    return true;
 }
 
 void print_token(Token* token) {
@@ -237,6 +319,33 @@ void print_token(Token* token) {
         case TOKEN_KIND_CARET:
             printf("<caret>\n");
             break;
+        case TOKEN_KIND_LESS:
+            printf("<less>\n");
+            break;
+        case TOKEN_KIND_LESS_EQUAL:
+            printf("<less_equal>\n");
+            break;
+        case TOKEN_KIND_GREATER:
+            printf("<greater>\n");
+            break;
+        case TOKEN_KIND_GREATER_EQUAL:
+            printf("<greater_equal>\n");
+            break;
+        case TOKEN_KIND_EQUAL:
+            printf("<equal>\n");
+            break;
+        case TOKEN_KIND_NOT_EQUAL:
+            printf("<not_equal>\n");
+            break;
+        case TOKEN_KIND_QUESTION:
+            printf("<question>\n");
+            break;
+        case TOKEN_KIND_COLON:
+            printf("<colon>\n");
+            break;
+        case TOKEN_KIND_COMMA:
+            printf("<comma>\n");
+            break;
         default:
             printf("token printing of this type is not implemented: %d\n", token->kind);
     }
@@ -253,7 +362,7 @@ void print_tokens(Token* token) {
     print_tokens(token->next);
 }
 
-void tokenize_str(Tokenizer* tokenizer, char* str) {
+bool tokenize_str(Tokenizer* tokenizer, const char* str) {
     uint32_t index = 0;
 
     while (str[index] != '\0') {
@@ -268,12 +377,24 @@ void tokenize_str(Tokenizer* tokenizer, char* str) {
         } else if (str[index] == ')') {
             construct_single_char_token(tokenizer, TOKEN_KIND_RPAREN);
             ++index;
+        } else if (str[index] == '?') {
+            construct_single_char_token(tokenizer, TOKEN_KIND_QUESTION);
+            ++index;
+        } else if (str[index] == ':') {
+            construct_single_char_token(tokenizer, TOKEN_KIND_COLON);
+            ++index;
+        } else if (str[index] == ',') {
+            construct_single_char_token(tokenizer, TOKEN_KIND_COMMA);
+            ++index;
         } else if (is_special_op(str[index])) {  // basic math operation like '*' or '+'
             construct_op_token(tokenizer, str[index]);
             ++index;
+        } else if (is_comparison(str[index])) {  // '<', '>=', '==', '!=' and so on
+            uint32_t advanced = construct_comparison_token(tokenizer, str, index);
+            index += advanced;
         } else if (is_word_char(str[index])) {
             char buffer[50];
-            get_word_str(tokenizer, buffer, 50, str, index);
+            if (!get_word_str(tokenizer, buffer, 50, str, index)) return false;
             uint32_t advanced = construct_word_token(tokenizer, buffer);
             index += advanced;
         } else {
@@ -282,8 +403,10 @@ void tokenize_str(Tokenizer* tokenizer, char* str) {
             panic(tokenizer, buffer);
         }
 
+        if (tokenizer->failed) return false;
         ++(tokenizer->_curr_col);
     }
 
     tokenizer->current = tokenizer->head;
+    return true;
 }
@@ -1,8 +1,11 @@
 #ifndef _TOKENIZER_H_
 #define _TOKENIZER_H_
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "allocator.h"
+
 typedef enum {
     TOKEN_KIND_LPAREN,
     TOKEN_KIND_RPAREN,
@@ -13,6 +16,15 @@ typedef enum {
     TOKEN_KIND_MULTIPLY,
     TOKEN_KIND_DIVIDE,
     TOKEN_KIND_CARET,
+    TOKEN_KIND_LESS,
+    TOKEN_KIND_LESS_EQUAL,
+    TOKEN_KIND_GREATER,
+    TOKEN_KIND_GREATER_EQUAL,
+    TOKEN_KIND_EQUAL,
+    TOKEN_KIND_NOT_EQUAL,
+    TOKEN_KIND_QUESTION,
+    TOKEN_KIND_COLON,
+    TOKEN_KIND_COMMA,
 } TokenKind;
 
 typedef struct Token Token;
@@ -25,16 +37,26 @@ struct Token {
 };
 
 typedef struct {
+    Allocator allocator;
+
     Token* head;
     Token* last;
     Token* current; // used for iteration
     uint32_t _curr_col; // used internally by tokenizer
+
+    uint32_t max_tokens;  // tokenize_str() fails past this many tokens, 0 for no limit
+    uint32_t token_count;
+
+    bool failed;         // set when tokenize_str() hit invalid input
+    bool out_of_memory;  // the failure was an allocation, not the input
+    bool limit_exceeded; // the failure was max_tokens, not the input
+    char error[150];     // description of the failure
 } Tokenizer;
 
 
-Tokenizer* create_tokenizer();
+Tokenizer* create_tokenizer(const Allocator* allocator);
 void free_tokenizer(Tokenizer* tokenizer);
-void tokenize_str(Tokenizer* tokenizer, char* str);
+bool tokenize_str(Tokenizer* tokenizer, const char* str);
 void print_tokens(Token* token);
 Token* tokenizer_curr(Tokenizer* tokenizer);
 Token* tokenizer_next(Tokenizer* tokenizer);
@@ -2,18 +2,37 @@
 #define _WORD_TABLE_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "parser.h"
 
-// #define NEW_WORD(new_word) strncmp(word, new_word, strlen(new_word))
+typedef struct {
+    char* name;
+    uint32_t arity;
+    NodeKind kind;
+} FunctionEntry;
 
-bool word_is_function(char* word) {
-    return strncmp(word, "sqrt", 4) == 0 ||
-           strncmp(word, "ln", 2) == 0 ||
-           strncmp(word, "log", 3) == 0 ||
-           strncmp(word, "pi", 2) == 0 ||
-           strncmp(word, "e", 1) == 0;
+static const FunctionEntry function_table[] = {
+    {"min", 2, NODE_KIND_MIN},
+    {"max", 2, NODE_KIND_MAX},
+    {"clamp", 3, NODE_KIND_CLAMP},
+};
+
+// Returns NULL when word doesn't name a function.
+static inline const FunctionEntry* find_function(char* word) {
+    for (size_t i = 0; i < sizeof(function_table) / sizeof(function_table[0]); ++i) {
+        if (strcmp(word, function_table[i].name) == 0) return &function_table[i];
+    }
+    return NULL;
+}
+
+// Operators spelled as words, they can't be used as variable names.
+static inline bool word_is_keyword(char* word) {
+    return strcmp(word, "and") == 0 ||
+           strcmp(word, "or") == 0 ||
+           strcmp(word, "not") == 0;
 }
 
 #endif // _WORD_TABLE_H